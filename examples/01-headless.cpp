@@ -1,5 +1,4 @@
 #include <cstdlib>
-#include <fstream>
 #include <iostream>
 #include <memory>
 
@@ -7,6 +6,7 @@
 #include <glm/gtx/transform2.hpp>
 
 #include "rendering/Depthbuffer.h"
+#include "rendering/FrameSink.h"
 #include "rendering/Framebuffer.h"
 #include "rendering/Pipeline.h"
 #include "rendering/Rasterizer.h"
@@ -23,6 +23,9 @@ std::unique_ptr<render::Rasterizer> rasterizer;
 render::RenderConfig renderConfig;
 std::shared_ptr<render::DefaultVertexTransform> vertexShader;
 
+// Writes the frames in the background while the next ones are rendered.
+std::unique_ptr<render::FrameSink> frameSink;
+
 using render::Vertex;
 
 const static int MAX_FRAMES = 36;
@@ -48,30 +51,12 @@ static void frame(int counter) {
   }
 }
 
-// Writes out a ppm image of the framebuffer.
+// Queues the framebuffer to be written out as a ppm image.
 void writeImage(int counter) {
   char filename[128];
   sprintf(filename, "%s-%02d.ppm", binaryName.c_str(), counter);
 
-  std::ofstream file(filename);
-  file << "P3" << std::endl;
-  ;
-  file << width << " " << height << std::endl;
-  file << 255 << std::endl;
-
-  for (unsigned int y = 0; y < renderConfig.framebuffer->getHeight(); ++y) {
-    for (unsigned int x = 0; x < renderConfig.framebuffer->getWidth(); ++x) {
-      const glm::vec4 &c =
-          renderConfig.framebuffer
-              ->getPixels()[x + y * renderConfig.framebuffer->getWidth()];
-      file << (int)(c.r * 255) << " " << (int)(c.g * 255) << " "
-           << (int)(c.b * 255) << " ";
-    }
-    file << std::endl;
-  }
-
-  std::clog << "Wrote " << filename << std::endl;
-  file.close();
+  frameSink->submit(renderConfig.framebuffer, filename);
 }
 
 int main(int argc, char **argv) {
@@ -83,11 +68,16 @@ int main(int argc, char **argv) {
   rasterizer = std::make_unique<render::Rasterizer>();
   renderConfig.viewport =
       std::make_shared<render::Viewport>(0, 0, width, height);
-  renderConfig.framebuffer =
-      std::make_shared<render::Framebuffer>(width, height);
+  // The images are written with 8 bits per channel. Each frame is rendered
+  // into a framebuffer from the sink.
+  frameSink = std::make_unique<render::FrameSink>(
+      width, height, render::PixelFormat::RGBA8, 3);
   renderConfig.depthbuffer =
       std::make_shared<render::Depthbuffer>(width, height);
 
+  // Nobody is waiting for us, so use all cores.
+  renderConfig.tiledRasterization = true;
+
   // Keep vertex shader separate so we can easily modify the transformation.
   vertexShader = std::make_shared<render::DefaultVertexTransform>();
   renderConfig.vertexShader = vertexShader;
@@ -110,9 +100,18 @@ int main(int argc, char **argv) {
 
   // Draw our frames.
   for (int i = 0; i < MAX_FRAMES; ++i) {
+    renderConfig.framebuffer = frameSink->acquire();
     frame(i);
     writeImage(i);
   }
 
+  frameSink->flush();
+  if (frameSink->getWriteErrors() > 0) {
+    std::cerr << "Could not write " << frameSink->getWriteErrors()
+              << " frames\n";
+    return 1;
+  }
+  std::clog << "Wrote " << MAX_FRAMES << " frames" << std::endl;
+
   return 0;
 }
@@ -39,14 +39,15 @@ protected:
       renderConfig.clearBuffers(glm::vec4(0.7f, 0.7f, 0.9f, 1));
 
       // Draw the floor grid.
-      rasterizer->drawLines(renderConfig, grid->getVertices(),
-                            grid->getIndices());
+      rasterizer->drawLines(renderConfig, grid->getVertexBuffer(),
+                            grid->getIndexBuffer());
 
       // Draw all the bunnies.
       for (auto bunny = bunnyList.begin(); bunny != bunnyList.end(); ++bunny) {
         dvt->modelMatrix = (*bunny)->transform;
-        rasterizer->drawTriangles(renderConfig, (*bunny)->getVertices(),
-                                  (*bunny)->getIndices());
+        rasterizer->drawTriangles(renderConfig,
+                                  (*bunny)->getVertexBuffer(),
+                                  (*bunny)->getIndexBuffer());
       }
     } catch (const char *txt) {
       std::cerr << "Render error :\"" << txt << "\"\n";
@@ -58,11 +59,23 @@ protected:
       renderConfig.drawTriangleBounds = !renderConfig.drawTriangleBounds;
     }
 
+    if (key == 'c') {
+      if (renderConfig.cullMode == render::CullMode::BACK) {
+        renderConfig.cullMode = render::CullMode::NONE;
+        std::cout << "Face culling disabled." << std::endl;
+      } else {
+        renderConfig.cullMode = render::CullMode::BACK;
+        std::cout << "Culling back faces." << std::endl;
+      }
+    }
+
     if (key == 'g') {
       std::unique_ptr<geometry::PlyGeometry> bunny =
           std::make_unique<geometry::PlyGeometry>();
 
-      bunny->loadPly("../models/bunny/reconstruction/bun_zipper_res3.ply");
+      // Parsed once, then loaded from the cache in the working directory.
+      bunny->loadPly("../models/bunny/reconstruction/bun_zipper_res3.ply",
+                     "bun_zipper_res3.meshcache");
 
       float randomAngle = (float)rand() / RAND_MAX;
       glm::vec3 randomAxis = glm::sphericalRand(1);
@@ -13,6 +13,8 @@
 class WireSphere : public geometry::Geometry {
 public:
   WireSphere(float radius) {
+    primitiveType = geometry::PrimitiveType::LINE_STRIP;
+
     // Circles of latitude (N - S), excluding the poles.
     for (int theta = -80; theta < 90; theta += 10) {
       // A full circle on the horizontal plane.
@@ -16,7 +16,7 @@
 
 class StippleShader : public render::FragmentShader {
 public:
-  render::Fragment &&shadeSingle(const render::ShadingGeometry &in) override {
+  render::Fragment shadeSingle(const render::ShadingGeometry &in) override {
 
     // Only stipple transparent fragments.
     if (in.color.a < 1 - FLT_EPSILON) {
@@ -33,15 +33,15 @@ public:
       glm::vec4 outColor(in.color);
       outColor.a = 1.f;
 
-      return std::move(render::Fragment{outColor});
+      return render::Fragment{outColor};
     } else {
-      return std::move(render::Fragment{in.color});
+      return render::Fragment{in.color};
     }
   }
 
 private:
-  inline static render::Fragment &&discard() {
-    return std::move(render::Fragment{glm::vec4(), true});
+  inline static render::Fragment discard() {
+    return render::Fragment{glm::vec4(), true};
   }
 };
 
@@ -118,8 +118,9 @@ protected:
     try {
       for (auto quad = quads.begin(); quad != quads.end(); ++quad) {
         dvt->modelMatrix = quad->get()->transform;
-        rasterizer->drawTriangles(renderConfig, quad->get()->getVertices(),
-                                  quad->get()->getIndices());
+        rasterizer->drawTriangles(renderConfig,
+                                  quad->get()->getVertexBuffer(),
+                                  quad->get()->getIndexBuffer());
       }
     } catch (const char *txt) {
       std::cerr << "Render error :\"" << txt << "\"\n";
@@ -37,7 +37,9 @@ protected:
 class RandomLinesGeometry : public BoundedGeometry {
 public:
   RandomLinesGeometry(const glm::vec3 &min, const glm::vec3 &max)
-      : BoundedGeometry(min, max) {}
+      : BoundedGeometry(min, max) {
+    primitiveType = geometry::PrimitiveType::LINES;
+  }
 
   void add() {
     const glm::vec4 a(glm::linearRand(minBounds.x, maxBounds.x),
@@ -63,7 +65,9 @@ public:
 class RandomPointsGeometry : public BoundedGeometry {
 public:
   RandomPointsGeometry(const glm::vec3 &min, const glm::vec3 &max)
-      : BoundedGeometry(min, max) {}
+      : BoundedGeometry(min, max) {
+    primitiveType = geometry::PrimitiveType::POINTS;
+  }
 
   void add() {
     const glm::vec4 p(glm::linearRand(minBounds.x, maxBounds.x),
@@ -205,16 +209,16 @@ protected:
     }
 
     try {
-      rasterizer->drawLines(renderConfig, lines->getVertices(),
-                            lines->getIndices());
+      rasterizer->drawLines(renderConfig, lines->getVertexBuffer(),
+                            lines->getIndexBuffer());
       rasterizer->drawPoints(renderConfig, points->getVertices(),
                              points->getIndices());
-      rasterizer->drawTriangles(renderConfig, triangles->getVertices(),
-                                triangles->getIndices());
+      rasterizer->drawTriangles(renderConfig, triangles->getVertexBuffer(),
+                                triangles->getIndexBuffer());
 
       if (drawGrid) {
-        rasterizer->drawLines(renderConfig, grid->getVertices(),
-                              grid->getIndices());
+        rasterizer->drawLines(renderConfig, grid->getVertexBuffer(),
+                              grid->getIndexBuffer());
       }
       rasterizer->drawLines(renderConfig, lineVertices, lineIndices);
     } catch (const std::string &error) {
@@ -15,29 +15,50 @@ class TextureShader : public render::FragmentShader {
 public:
   TextureShader() : texture(nullptr) {}
 
-  render::Fragment &&shadeSingle(const render::ShadingGeometry &in) override {
+  render::Fragment shadeSingle(const render::ShadingGeometry &in) override {
     render::Fragment fragment;
 
     if (texture) {
-      fragment.color = texture->getTexel(in.texcoord);
+      fragment.color =
+          texture->sample(in.texcoord, in.texcoordDx, in.texcoordDy);
     }
-    return std::move(fragment);
+    return fragment;
   }
 
   inline void setTexture(std::shared_ptr<render::Texture> texture) {
+    if (texture) {
+      texture->setFilter(filter);
+      texture->setStorage(format, render::BufferLayout::TILED);
+    }
     this->texture = texture;
   }
 
+  // Switches to the next texture filter.
+  inline render::TextureFilter cycleFilter() {
+    filter = (render::TextureFilter)(((int)filter + 1) % 3);
+    if (texture)
+      texture->setFilter(filter);
+    return filter;
+  }
+
+  // Switches to the next storage format for the textures set from now on.
+  inline render::TextureFormat cycleFormat() {
+    format = (render::TextureFormat)(((int)format + 1) % 4);
+    return format;
+  }
+
 private:
   std::shared_ptr<render::Texture> texture;
+  render::TextureFilter filter = render::TextureFilter::TRILINEAR;
+  render::TextureFormat format = render::TextureFormat::RGBA8;
 };
 
 class TexCoordShader : public render::FragmentShader {
 public:
-  render::Fragment &&shadeSingle(const render::ShadingGeometry &in) override {
+  render::Fragment shadeSingle(const render::ShadingGeometry &in) override {
     render::Fragment fragment;
     fragment.color = glm::vec4(in.texcoord, 0.f, 1.f);
-    return std::move(fragment);
+    return fragment;
   }
 };
 
@@ -77,8 +98,19 @@ protected:
 
     try {
       dvt->modelMatrix = quad->transform;
-      rasterizer->drawTriangles(renderConfig, quad->getVertices(),
-                                quad->getIndices());
+      if (depthPrepass) {
+        // Lay down depth first, then shade each visible pixel once.
+        renderConfig.depthPass = render::DepthPass::DEPTH_ONLY;
+        rasterizer->drawTriangles(renderConfig, quad->getVertexBuffer(),
+                                  quad->getIndexBuffer());
+        renderConfig.depthPass = render::DepthPass::SHADE_VISIBLE;
+      }
+      rasterizer->drawTriangles(renderConfig, quad->getVertexBuffer(),
+                                quad->getIndexBuffer());
+      renderConfig.depthPass = render::DepthPass::COMBINED;
+
+      if (renderConfig.gbuffer)
+        rasterizer->shadeGBuffer(renderConfig);
     } catch (const char *txt) {
       std::cerr << "Render error :\"" << txt << "\"\n";
     }
@@ -102,6 +134,40 @@ protected:
       renderConfig.fragmentShader = textureShader;
     }
 
+    // Toggle the depth pre-pass and report how many fragments the last frame
+    // shaded.
+    if (key == 'z') {
+      depthPrepass = !depthPrepass;
+      const render::DebugInfo &info = rasterizer->getDebugInfo();
+      std::cout << "Depth pre-pass " << (depthPrepass ? "on" : "off")
+                << "; last frame shaded " << info.fragmentsShaded << " of "
+                << info.fragmentsRasterized << " rasterized fragments\n";
+    }
+
+    if (key == 'm') {
+      const char *names[] = {"nearest", "bilinear", "trilinear"};
+      std::cout << "Texture filter: "
+                << names[(int)textureShader->cycleFilter()] << "\n";
+    }
+
+    if (key == 'k') {
+      const char *names[] = {"RGBA32F", "RGBA8", "BC1", "BC3"};
+      std::cout << "Texture format: "
+                << names[(int)textureShader->cycleFormat()]
+                << " (reload the texture to apply)\n";
+    }
+
+    // Toggle deferred shading.
+    if (key == 'g') {
+      if (renderConfig.gbuffer) {
+        renderConfig.gbuffer.reset();
+      } else {
+        renderConfig.gbuffer = std::make_shared<render::GBuffer>(
+            renderConfig.framebuffer->getWidth(),
+            renderConfig.framebuffer->getHeight());
+      }
+    }
+
     // Set texture coord debugging shader.
     if (key == 't') {
       renderConfig.fragmentShader = texCoordShader;
@@ -112,6 +178,7 @@ private:
   std::unique_ptr<geometry::Quad> quad;
   std::shared_ptr<TextureShader> textureShader;
   std::shared_ptr<TexCoordShader> texCoordShader;
+  bool depthPrepass = false;
 };
 
 int main(int argc, char **argv) {
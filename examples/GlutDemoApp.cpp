@@ -21,8 +21,9 @@ GlutDemoApp::GlutDemoApp(const std::string &name)
 
   renderConfig.viewport =
       std::make_shared<render::Viewport>(0, 0, width, height);
-  renderConfig.framebuffer =
-      std::make_shared<render::Framebuffer>(width, height);
+  // The window only shows 8 bits per channel anyway.
+  renderConfig.framebuffer = std::make_shared<render::Framebuffer>(
+      width, height, render::PixelFormat::RGBA8);
   renderConfig.depthbuffer =
       std::make_shared<render::Depthbuffer>(width, height);
 
@@ -102,10 +103,19 @@ void GlutDemoApp::glutDisplay() {
 
   // if (appInstance->renderTarget.framebuffer)
   {
+    const render::Framebuffer &framebuffer =
+        *appInstance->renderConfig.framebuffer;
+    GLenum format = GL_RGBA, type = GL_FLOAT;
+    if (framebuffer.getFormat() == render::PixelFormat::RGBA8) {
+      type = GL_UNSIGNED_BYTE;
+    } else if (framebuffer.getFormat() == render::PixelFormat::RGB565) {
+      format = GL_RGB;
+      type = GL_UNSIGNED_SHORT_5_6_5;
+    }
+
     glBindTexture(GL_TEXTURE_2D, appInstance->texture);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, appInstance->width,
-                 appInstance->height, 0, GL_RGBA, GL_FLOAT,
-                 appInstance->renderConfig.framebuffer->getPixels());
+                 appInstance->height, 0, format, type, framebuffer.getData());
 
     glEnable(GL_TEXTURE_2D);
     glEnableClientState(GL_VERTEX_ARRAY);
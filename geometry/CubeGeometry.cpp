@@ -10,7 +10,8 @@ using render::Vertex;
 namespace geometry {
 
 CubeGeometry::CubeGeometry(const glm::vec3 &sidelength) {
-  // create a cube
+  // create a cube, drawn as its edges
+  primitiveType = PrimitiveType::LINES;
   vertices.push_back(Vertex(vec4(-1, 1, 1, 1)));
   vertices.push_back(Vertex(vec4(-1, -1, 1, 1)));
   vertices.push_back(Vertex(vec4(1, -1, 1, 1)));
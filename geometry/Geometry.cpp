@@ -1,7 +1,41 @@
 #include "Geometry.h"
+#include "MeshOptimizer.h"
+
+#include <utility>
 
 namespace geometry {
 
 Geometry::Geometry() : transform() {}
 
-}
\ No newline at end of file
+Geometry::OptimizationReport Geometry::optimize(bool reduceOverdraw) {
+  // Lines or points would be regrouped into triangles.
+  if (primitiveType != PrimitiveType::TRIANGLES || indices.size() % 3 != 0)
+    return OptimizationReport{0.f, 0.f};
+
+  VertexList vertexList = vertices.getVertices();
+  IndexList indexList = indices.getIndices();
+
+  OptimizationReport report;
+  report.acmrBefore = computeACMR(indexList, vertexList.size());
+
+  std::vector<size_t> clusters;
+  optimizeVertexCache(indexList, vertexList.size(), DEFAULT_VERTEX_CACHE_SIZE,
+                      reduceOverdraw ? &clusters : nullptr);
+  if (reduceOverdraw)
+    optimizeOverdraw(indexList, vertexList, clusters);
+  const size_t usedVertices = optimizeVertexFetch(vertexList, indexList);
+
+  report.acmrAfter = computeACMR(indexList, vertexList.size());
+
+  // No vertex is dropped -- unused ones are moved to the end -- so the bounds
+  // stay the same; the indices still refer to the used vertices only.
+  const glm::vec3 boundsMin = vertices.getBoundsMin();
+  const glm::vec3 boundsMax = vertices.getBoundsMax();
+  vertices.assign(std::move(vertexList), boundsMin, boundsMax);
+  indices.assign(std::move(indexList), usedVertices);
+
+  optimized = true;
+  return report;
+}
+
+} // namespace geometry
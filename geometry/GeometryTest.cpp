@@ -0,0 +1,464 @@
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "CubeGeometry.h"
+#include "Geometry.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshProcessing.h"
+#include "PlyGeometry.h"
+
+using namespace geometry;
+using glm::vec3;
+using glm::vec4;
+using render::Vertex;
+using render::WorkerPool;
+
+// A small mesh: a square in the XY plane, stored as a single polygon, and two
+// triangles going up from it to a fifth vertex.
+static const float MESH_POSITIONS[][3] = {
+    {0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {0, 1, 0}, {0.5f, 0.5f, 1}};
+static const std::vector<std::vector<int>> MESH_FACES = {
+    {0, 1, 2, 3}, {0, 1, 4}, {1, 2, 4}};
+// The polygon is split into a fan of triangles.
+static const IndexList MESH_INDICES = {0, 1, 2, 0, 2, 3, 0, 1, 4, 1, 2, 4};
+
+std::string makePlyHeader(const std::string &format) {
+  std::ostringstream header;
+  header << "ply\n"
+         << "format " << format << " 1.0\n"
+         << "comment written by gfx93-geometry-test\n"
+         << "element vertex 5\n"
+         << "property float x\n"
+         << "property float y\n"
+         << "property float z\n"
+         << "element face " << MESH_FACES.size() << "\n"
+         << "property list uchar int vertex_indices\n"
+         << "end_header\n";
+  return header.str();
+}
+
+std::string makeAsciiPly() {
+  std::ostringstream ply;
+  ply << makePlyHeader("ascii");
+  for (const auto &p : MESH_POSITIONS) {
+    ply << p[0] << " " << p[1] << " " << p[2] << "\n";
+  }
+  for (const auto &face : MESH_FACES) {
+    ply << face.size();
+    for (int index : face) {
+      ply << " " << index;
+    }
+    ply << "\n";
+  }
+  return ply.str();
+}
+
+// Appends the bytes of value in the given byte order.
+template <typename T>
+void appendValue(std::string &data, T value, bool bigEndian) {
+  char bytes[sizeof(T)];
+  memcpy(bytes, &value, sizeof(T));
+
+  const uint16_t one = 1;
+  const bool hostBigEndian = *reinterpret_cast<const char *>(&one) == 0;
+  if (bigEndian != hostBigEndian) {
+    std::reverse(bytes, bytes + sizeof(T));
+  }
+  data.append(bytes, sizeof(T));
+}
+
+std::string makeBinaryPly(bool bigEndian) {
+  std::string ply = makePlyHeader(bigEndian ? "binary_big_endian"
+                                            : "binary_little_endian");
+  for (const auto &p : MESH_POSITIONS) {
+    for (float value : p) {
+      appendValue(ply, value, bigEndian);
+    }
+  }
+  for (const auto &face : MESH_FACES) {
+    appendValue(ply, (uint8_t)face.size(), bigEndian);
+    for (int index : face) {
+      appendValue(ply, (int32_t)index, bigEndian);
+    }
+  }
+  return ply;
+}
+
+void writeFile(const std::string &filename, const std::string &data) {
+  std::ofstream(filename, std::ios::binary) << data;
+}
+
+std::string readFile(const std::string &filename) {
+  std::ifstream file(filename, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(file),
+                     std::istreambuf_iterator<char>());
+}
+
+bool loadPlyData(const std::string &data, PlyGeometry &geometry) {
+  const std::string filename = "gfx93-geometry-test.ply";
+  writeFile(filename, data);
+  const bool loaded = geometry.loadPly(filename);
+  std::remove(filename.c_str());
+  return loaded;
+}
+
+int testPlyFormats() {
+  PlyGeometry ascii, little, big;
+  assert(loadPlyData(makeAsciiPly(), ascii));
+  assert(loadPlyData(makeBinaryPly(false), little));
+  assert(loadPlyData(makeBinaryPly(true), big));
+
+  assert(ascii.getVertices().size() == 5);
+  for (size_t i = 0; i < 5; ++i) {
+    const vec4 &p = ascii.getVertices()[i].position;
+    assert(p == vec4(MESH_POSITIONS[i][0], MESH_POSITIONS[i][1],
+                     MESH_POSITIONS[i][2], 1.f));
+  }
+  assert(ascii.getIndices() == MESH_INDICES);
+
+  // All three load to exactly the same mesh, computed normals included.
+  for (const PlyGeometry *binary : {&little, &big}) {
+    assert(binary->getIndices() == ascii.getIndices());
+    assert(binary->getVertices().size() == ascii.getVertices().size());
+    for (size_t i = 0; i < ascii.getVertices().size(); ++i) {
+      const Vertex &a = ascii.getVertices()[i];
+      const Vertex &b = binary->getVertices()[i];
+      assert(a.position == b.position && a.normal == b.normal);
+    }
+  }
+
+  // Loading again replaces the mesh rather than appending to it.
+  assert(loadPlyData(makeBinaryPly(false), ascii));
+  assert(ascii.getVertices().size() == 5);
+  assert(ascii.getIndices() == MESH_INDICES);
+  return 0;
+}
+
+int testPlyInvalid() {
+  PlyGeometry geometry;
+
+  // Truncated in the middle of the faces.
+  const std::string binary = makeBinaryPly(false);
+  assert(!loadPlyData(binary.substr(0, binary.size() - 6), geometry));
+  const std::string ascii = makeAsciiPly();
+  assert(!loadPlyData(ascii.substr(0, ascii.size() - 8), geometry));
+
+  // An index past the last vertex, and a negative one.
+  std::string outOfRange = ascii;
+  outOfRange.replace(outOfRange.rfind("4\n"), 1, "5");
+  assert(!loadPlyData(outOfRange, geometry));
+  std::string negative = ascii;
+  negative.replace(negative.rfind("4\n"), 1, "-1");
+  assert(!loadPlyData(negative, geometry));
+
+  // A count far beyond the data fails instead of allocating for it.
+  std::string huge = binary;
+  huge.replace(huge.find("vertex 5"), 8, "vertex 100000000000");
+  assert(!loadPlyData(huge, geometry));
+
+  assert(!geometry.loadPly("gfx93-geometry-test-missing.ply"));
+
+  // None of the failures left a partly read mesh behind, and neither does
+  // one after a successful load.
+  assert(geometry.getVertices().empty() && geometry.getIndices().empty());
+  assert(loadPlyData(ascii, geometry));
+  assert(!loadPlyData(outOfRange, geometry));
+  assert(geometry.getVertices().size() == 5);
+  assert(geometry.getIndices() == MESH_INDICES);
+  assert(geometry.getBoundingSphereRadius() > 0.f);
+  return 0;
+}
+
+// A wavy grid of size x size quads, two triangles each.
+void makeGrid(int size, VertexList &vertices, IndexList &indices) {
+  for (int y = 0; y <= size; ++y) {
+    for (int x = 0; x <= size; ++x) {
+      const float z = std::sin(x * 0.3f) * std::cos(y * 0.2f);
+      vertices.push_back(Vertex(vec4(x, y, z, 1.f)));
+    }
+  }
+  for (int y = 0; y < size; ++y) {
+    for (int x = 0; x < size; ++x) {
+      const unsigned int i = y * (size + 1) + x;
+      const unsigned int quad[] = {i,     i + 1,        i + size + 2,
+                                   i,     i + size + 2, i + size + 1};
+      indices.insert(indices.end(), quad, quad + 6);
+    }
+  }
+}
+
+int testVertexNormals() {
+  VertexList vertexList;
+  IndexList indexList;
+  makeGrid(100, vertexList, indexList);
+
+  // Degenerate triangles: one with a repeated vertex, and one with all three
+  // corners on a line, each using vertices of their own.
+  const unsigned int first = vertexList.size();
+  vertexList.push_back(Vertex(vec4(0, 0, 5, 1)));
+  vertexList.push_back(Vertex(vec4(1, 0, 5, 1)));
+  vertexList.push_back(Vertex(vec4(0, 0, 6, 1)));
+  vertexList.push_back(Vertex(vec4(1, 1, 6, 1)));
+  vertexList.push_back(Vertex(vec4(2, 2, 6, 1)));
+  const unsigned int degenerate[] = {first,     first,     first + 1,
+                                     first + 2, first + 3, first + 4};
+  indexList.insert(indexList.end(), degenerate, degenerate + 6);
+
+  // Serial reference: the sum of the unit normals of a vertex's triangles.
+  std::vector<vec3> expected(vertexList.size(), vec3(0.f));
+  for (size_t i = 0; i < indexList.size(); i += 3) {
+    const vec3 a(vertexList[indexList[i + 0]].position);
+    const vec3 b(vertexList[indexList[i + 1]].position);
+    const vec3 c(vertexList[indexList[i + 2]].position);
+    const vec3 n = glm::cross(b - a, c - a);
+    if (glm::length(n) > 0.f) {
+      for (int k = 0; k < 3; ++k) {
+        expected[indexList[i + k]] += glm::normalize(n);
+      }
+    }
+  }
+
+  for (unsigned int threads : {1u, 4u}) {
+    VertexBuffer vertices(vertexList);
+    const IndexBuffer indices(indexList);
+    WorkerPool pool(threads);
+    computeVertexNormals(pool, vertices, indices);
+
+    for (size_t v = 0; v < vertices.size(); ++v) {
+      const vec3 &n = vertices[v].normal;
+      if (v >= first) {
+        assert(n == vec3(0.f));
+      } else {
+        assert(glm::length(n - glm::normalize(expected[v])) < 1e-5f);
+      }
+    }
+  }
+  return 0;
+}
+
+// Overwrites a field of the cache header in a copy of the file.
+template <typename T>
+std::string patchCache(const std::string &data, size_t offset, T value) {
+  std::string patched = data;
+  memcpy(&patched[offset], &value, sizeof(T));
+  return patched;
+}
+
+bool readCacheData(const std::string &data) {
+  const std::string filename = "gfx93-geometry-test-patched.cache";
+  writeFile(filename, data);
+  VertexBuffer vertices;
+  IndexBuffer indices;
+  MeshCacheInfo info;
+  const bool read = readMeshCache(filename, vertices, indices, info);
+  std::remove(filename.c_str());
+  return read;
+}
+
+int testMeshCache() {
+  VertexList vertexList;
+  IndexList indexList;
+  makeGrid(10, vertexList, indexList);
+  const VertexBuffer vertices(vertexList);
+  const IndexBuffer indices(indexList);
+
+  MeshCacheInfo info;
+  info.boundsMin = vec3(0, 0, -1);
+  info.boundsMax = vec3(10, 10, 1);
+  info.boundingSphereRadius = 14.2f;
+  info.optimizedIndexOrder = true;
+  info.source.size = 1234;
+  info.source.mtimeSec = 1500000000;
+  info.source.mtimeNsec = 123456789;
+
+  const std::string filename = "gfx93-geometry-test.cache";
+  // The umask decides who may read the cache, not the temporary file it was
+  // written to.
+  const mode_t mask = umask(022);
+  assert(writeMeshCache(filename, vertices, indices, info));
+  umask(mask);
+  struct stat status;
+  assert(stat(filename.c_str(), &status) == 0);
+  assert((status.st_mode & 0777) == 0644);
+
+  // Round trip.
+  VertexBuffer readVertices;
+  IndexBuffer readIndices;
+  MeshCacheInfo readInfo;
+  assert(readMeshCache(filename, readVertices, readIndices, readInfo));
+  assert(readIndices.getIndices() == indexList);
+  assert(readVertices.size() == vertexList.size());
+  for (size_t i = 0; i < vertexList.size(); ++i) {
+    const Vertex &a = readVertices[i];
+    const Vertex &b = vertexList[i];
+    assert(a.position == b.position && a.normal == b.normal &&
+           a.color == b.color && a.texcoord == b.texcoord);
+  }
+  assert(readInfo.boundsMin == info.boundsMin);
+  assert(readInfo.boundsMax == info.boundsMax);
+  assert(readInfo.boundingSphereRadius == info.boundingSphereRadius);
+  assert(readInfo.optimizedIndexOrder);
+  assert(readInfo.source == info.source);
+
+  // A different source is stale.
+  MeshCacheSource source = info.source;
+  assert(readMeshCache(filename, readVertices, readIndices, readInfo,
+                       &source));
+  source.mtimeNsec += 1;
+  assert(!readMeshCache(filename, readVertices, readIndices, readInfo,
+                        &source));
+
+  const std::string data = readFile(filename);
+  std::remove(filename.c_str());
+  assert(readCacheData(data));
+
+  MeshCacheHeader header;
+  memcpy(&header, data.data(), sizeof(header));
+
+  assert(!readCacheData(
+      patchCache(data, offsetof(MeshCacheHeader, magic), (uint32_t)0)));
+  assert(!readCacheData(patchCache(data, offsetof(MeshCacheHeader, version),
+                                   MeshCacheHeader::VERSION + 1)));
+  assert(!readCacheData(data.substr(0, data.size() - 4)));
+  assert(!readCacheData(data.substr(0, sizeof(MeshCacheHeader) - 1)));
+
+  // An index to the vertex after the last.
+  const size_t lastIndex =
+      header.indexOffset + (header.indexCount - 1) * sizeof(unsigned int);
+  assert(!readCacheData(
+      patchCache(data, lastIndex, (unsigned int)header.vertexCount)));
+
+  // Offsets that are not aligned, even with the arrays still in the file.
+  assert(!readCacheData(patchCache(data,
+                                   offsetof(MeshCacheHeader, indexOffset),
+                                   header.indexOffset - 4)));
+  assert(!readCacheData(patchCache(data,
+                                   offsetof(MeshCacheHeader, vertexOffset),
+                                   header.vertexOffset + 4)));
+  return 0;
+}
+
+// A geometry made of the triangles of a grid, in scanline order.
+class TriangleGridGeometry : public Geometry {
+public:
+  explicit TriangleGridGeometry(int size) {
+    VertexList vertexList;
+    IndexList indexList;
+    makeGrid(size, vertexList, indexList);
+    vertices.assign(vertexList);
+    indices.assign(indexList);
+  }
+
+  // Adds a vertex that no triangle refers to.
+  void addUnusedVertex(const Vertex &v) { vertices.push_back(v); }
+};
+
+// The triangles as position triples, each rotated to start at its smallest
+// corner so that the winding is kept, and sorted.
+typedef std::array<float, 9> Triangle;
+std::vector<Triangle> getTriangles(const Geometry &geometry) {
+  const VertexList &vertices = geometry.getVertices();
+  const IndexList &indices = geometry.getIndices();
+
+  std::vector<Triangle> triangles;
+  for (size_t i = 0; i < indices.size(); i += 3) {
+    std::array<std::array<float, 3>, 3> corners;
+    for (int k = 0; k < 3; ++k) {
+      const vec4 &p = vertices[indices[i + k]].position;
+      corners[k] = {p.x, p.y, p.z};
+    }
+    std::rotate(corners.begin(),
+                std::min_element(corners.begin(), corners.end()),
+                corners.end());
+
+    Triangle triangle;
+    for (int k = 0; k < 9; ++k) {
+      triangle[k] = corners[k / 3][k % 3];
+    }
+    triangles.push_back(triangle);
+  }
+  std::sort(triangles.begin(), triangles.end());
+  return triangles;
+}
+
+int testOptimize() {
+  for (bool reduceOverdraw : {false, true}) {
+    TriangleGridGeometry grid(64);
+    const std::vector<Triangle> before = getTriangles(grid);
+
+    const Geometry::OptimizationReport report = grid.optimize(reduceOverdraw);
+    assert(grid.isOptimized());
+    assert(getTriangles(grid) == before);
+
+    assert(report.acmrAfter <= report.acmrBefore);
+    assert(report.acmrAfter ==
+           computeACMR(grid.getIndices(), grid.getVertices().size()));
+  }
+
+  // Unused vertices are kept at the end, and so are the bounds.
+  TriangleGridGeometry grid(8);
+  const Vertex unused(vec4(-5, 20, 3, 1));
+  grid.addUnusedVertex(unused);
+  const vec3 boundsMin = grid.getVertexBuffer().getBoundsMin();
+  const vec3 boundsMax = grid.getVertexBuffer().getBoundsMax();
+  const size_t vertexCount = grid.getVertices().size();
+
+  grid.optimize();
+  assert(grid.getVertices().size() == vertexCount);
+  assert(grid.getVertices().back().position == unused.position);
+  assert(grid.getIndexBuffer().getRequiredVertexCount() == vertexCount - 1);
+  assert(grid.getVertexBuffer().getBoundsMin() == boundsMin);
+  assert(grid.getVertexBuffer().getBoundsMax() == boundsMax);
+  assert(boundsMin.x == -5 && boundsMax.y == 20);
+
+  // The 24 edge indices of a cube are lines, not eight triangles.
+  CubeGeometry cube(vec3(1.f));
+  assert(cube.getPrimitiveType() == PrimitiveType::LINES);
+  const IndexList edges = cube.getIndices();
+  assert(edges.size() % 3 == 0);
+  const Geometry::OptimizationReport report = cube.optimize();
+  assert(report.acmrBefore == 0.f && report.acmrAfter == 0.f);
+  assert(!cube.isOptimized());
+  assert(cube.getIndices() == edges);
+  return 0;
+}
+
+int main(int argc, const char **argv) {
+  const std::string test(argv[1]);
+
+  if (test == "ply-formats") {
+    return testPlyFormats();
+  }
+
+  if (test == "ply-invalid") {
+    return testPlyInvalid();
+  }
+
+  if (test == "vertex-normals") {
+    return testVertexNormals();
+  }
+
+  if (test == "mesh-cache") {
+    return testMeshCache();
+  }
+
+  if (test == "optimize") {
+    return testOptimize();
+  }
+
+  return 0;
+}
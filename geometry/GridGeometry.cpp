@@ -16,6 +16,8 @@ GridGeometry::GridGeometry() {
   static const vec4 MAJOR_COLOR(1.f);
   static const vec4 MINOR_COLOR(0, 0, 0.7f, 1);
 
+  primitiveType = PrimitiveType::LINES;
+
   // Create a grid
   for (int x = -LENGTH; x <= LENGTH; x += STEP) {
     Vertex a(vec4(x, 0, -LENGTH, 1));
@@ -51,9 +53,9 @@ GridGeometry::GridGeometry() {
     indices.push_back(vertices.size() - 2);
   }
 
-  for (auto v : vertices) {
-    v.normal = vec3(0, 1, 0);
-    v.color = vec4(1, 1, 1, 1);
+  // The grid lies in the x/z plane.
+  for (size_t i = 0; i < vertices.size(); ++i) {
+    vertices[i].normal = vec3(0, 1, 0);
   }
 }
 }
\ No newline at end of file
@@ -0,0 +1,192 @@
+#include "MeshCache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../rendering/MappedFile.h"
+
+using render::IndexList;
+using render::Vertex;
+using render::VertexList;
+
+namespace geometry {
+
+static_assert(std::is_trivially_copyable<Vertex>::value,
+              "vertices are stored as raw bytes");
+
+namespace {
+
+const uint64_t ALIGNMENT = 16;
+
+inline uint64_t align(uint64_t offset) {
+  return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+inline bool writePadding(FILE *file, uint64_t size) {
+  const char padding[ALIGNMENT] = {};
+  return fwrite(padding, 1, size, file) == size;
+}
+
+} // namespace
+
+bool writeMeshCache(const std::string &filename,
+                    const render::VertexBuffer &vertices,
+                    const render::IndexBuffer &indices,
+                    const MeshCacheInfo &info) {
+  MeshCacheHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = MeshCacheHeader::MAGIC;
+  header.version = MeshCacheHeader::VERSION;
+  header.byteOrder = MeshCacheHeader::BYTE_ORDER_MARK;
+  header.headerSize = sizeof(MeshCacheHeader);
+  header.vertexSize = sizeof(Vertex);
+  header.flags =
+      info.optimizedIndexOrder ? MeshCacheHeader::OPTIMIZED_INDEX_ORDER : 0;
+  header.vertexCount = vertices.size();
+  header.vertexOffset = align(sizeof(MeshCacheHeader));
+  header.indexCount = indices.size();
+  header.indexOffset =
+      align(header.vertexOffset + header.vertexCount * sizeof(Vertex));
+  for (int i = 0; i < 3; ++i) {
+    header.boundsMin[i] = info.boundsMin[i];
+    header.boundsMax[i] = info.boundsMax[i];
+  }
+  header.boundingSphereRadius = info.boundingSphereRadius;
+  header.sourceSize = info.source.size;
+  header.sourceMtimeSec = info.source.mtimeSec;
+  header.sourceMtimeNsec = info.source.mtimeNsec;
+
+  // Written to a temporary file that replaces the cache once it is complete,
+  // so that nobody ever reads half a cache. Every writer gets a file of its
+  // own, so that two processes writing the same cache do not mix their data.
+  // Unlike mkstemp(), which makes the file private to its owner, the umask
+  // decides who may read the cache, as for any other file.
+  static std::atomic<unsigned int> temporaryCount(0);
+  std::string temporary;
+  int fd = -1;
+  for (int attempt = 0; fd == -1 && attempt < 100; ++attempt) {
+    temporary = filename + "." + std::to_string(getpid()) + "." +
+                std::to_string(temporaryCount++);
+    fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+    if (fd == -1 && errno != EEXIST)
+      return false;
+  }
+  if (fd == -1)
+    return false;
+
+  FILE *file = fdopen(fd, "wb");
+  if (!file) {
+    close(fd);
+    remove(temporary.c_str());
+    return false;
+  }
+
+  const uint64_t vertexEnd =
+      header.vertexOffset + header.vertexCount * sizeof(Vertex);
+  bool written =
+      fwrite(&header, sizeof(header), 1, file) == 1 &&
+      writePadding(file, header.vertexOffset - sizeof(header)) &&
+      fwrite(vertices.getVertices().data(), sizeof(Vertex), vertices.size(),
+             file) == vertices.size() &&
+      writePadding(file, header.indexOffset - vertexEnd) &&
+      fwrite(indices.getIndices().data(), sizeof(unsigned int),
+             indices.size(), file) == indices.size();
+
+  written = fclose(file) == 0 && written;
+  if (!written || rename(temporary.c_str(), filename.c_str()) != 0) {
+    remove(temporary.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool readMeshCache(const std::string &filename, render::VertexBuffer &vertices,
+                   render::IndexBuffer &indices, MeshCacheInfo &info,
+                   const MeshCacheSource *expectedSource) {
+  const render::MappedFile file(filename);
+  if (file.getSize() < sizeof(MeshCacheHeader))
+    return false;
+
+  MeshCacheHeader header;
+  memcpy(&header, file.getData(), sizeof(header));
+  if (header.magic != MeshCacheHeader::MAGIC ||
+      header.version != MeshCacheHeader::VERSION ||
+      header.byteOrder != MeshCacheHeader::BYTE_ORDER_MARK ||
+      header.headerSize != sizeof(MeshCacheHeader) ||
+      header.vertexSize != sizeof(Vertex)) {
+    return false;
+  }
+
+  MeshCacheSource source;
+  source.size = header.sourceSize;
+  source.mtimeSec = header.sourceMtimeSec;
+  source.mtimeNsec = header.sourceMtimeNsec;
+  if (expectedSource && source != *expectedSource)
+    return false;
+
+  // Both arrays have to be aligned and within the file; the counts are checked
+  // against the file size first so that the products cannot overflow.
+  const uint64_t size = file.getSize();
+  if (header.vertexCount > size / sizeof(Vertex) ||
+      header.indexCount > size / sizeof(unsigned int) ||
+      header.vertexOffset < sizeof(MeshCacheHeader) ||
+      header.vertexOffset % ALIGNMENT != 0 ||
+      header.indexOffset % ALIGNMENT != 0 ||
+      header.vertexOffset > size ||
+      header.vertexCount * sizeof(Vertex) > size - header.vertexOffset ||
+      header.indexOffset > size ||
+      header.indexCount * sizeof(unsigned int) > size - header.indexOffset ||
+      header.indexCount % 3 != 0) {
+    return false;
+  }
+
+  const Vertex *vertexData =
+      reinterpret_cast<const Vertex *>(file.getData() + header.vertexOffset);
+  const unsigned int *indexData = reinterpret_cast<const unsigned int *>(
+      file.getData() + header.indexOffset);
+
+  // Every index has to refer to a vertex.
+  size_t requiredVertices = 0;
+  for (size_t i = 0; i < header.indexCount; ++i) {
+    requiredVertices = std::max(requiredVertices, (size_t)indexData[i] + 1);
+  }
+  if (requiredVertices > header.vertexCount)
+    return false;
+
+  info.boundsMin = glm::vec3(header.boundsMin[0], header.boundsMin[1],
+                             header.boundsMin[2]);
+  info.boundsMax = glm::vec3(header.boundsMax[0], header.boundsMax[1],
+                             header.boundsMax[2]);
+  info.boundingSphereRadius = header.boundingSphereRadius;
+  info.optimizedIndexOrder =
+      (header.flags & MeshCacheHeader::OPTIMIZED_INDEX_ORDER) != 0;
+  info.source = source;
+
+  vertices.assign(VertexList(vertexData, vertexData + header.vertexCount),
+                  info.boundsMin, info.boundsMax);
+  indices.assign(IndexList(indexData, indexData + header.indexCount),
+                 requiredVertices);
+  return true;
+}
+
+bool getMeshCacheSource(const std::string &filename, MeshCacheSource &source) {
+  struct stat fileStat;
+  if (stat(filename.c_str(), &fileStat) != 0)
+    return false;
+
+  source.size = fileStat.st_size;
+  source.mtimeSec = fileStat.st_mtim.tv_sec;
+  source.mtimeNsec = fileStat.st_mtim.tv_nsec;
+  return true;
+}
+
+} // namespace geometry
@@ -0,0 +1,97 @@
+#ifndef GFX1993_MESHCACHE_H
+#define GFX1993_MESHCACHE_H
+
+#include <cstdint>
+#include <string>
+
+#include <glm/glm.hpp>
+
+#include "../rendering/VertexBuffer.h"
+
+namespace geometry {
+
+// A binary cache of a preprocessed mesh, so that it does not have to be parsed
+// and preprocessed again on every start. The vertices and indices are stored
+// in the memory layout of render::Vertex and the index lists, so reading the
+// cache is a validation of the header and a copy out of the mapped file.
+//
+// Caches are specific to the build that wrote them: a different vertex layout
+// or byte order makes them invalid, as does a different format version.
+
+// Identifies the state of the file a mesh was loaded from; a cache is stale
+// once the file's size or modification time differ from the recorded ones.
+struct MeshCacheSource {
+  uint64_t size = 0;
+  int64_t mtimeSec = 0;
+  int64_t mtimeNsec = 0;
+
+  inline bool operator==(const MeshCacheSource &other) const {
+    return size == other.size && mtimeSec == other.mtimeSec &&
+           mtimeNsec == other.mtimeNsec;
+  }
+  inline bool operator!=(const MeshCacheSource &other) const {
+    return !(*this == other);
+  }
+};
+
+// Properties of the mesh that are stored along with it.
+struct MeshCacheInfo {
+  glm::vec3 boundsMin = glm::vec3(0.f);
+  glm::vec3 boundsMax = glm::vec3(0.f);
+  float boundingSphereRadius = 0.f;
+  // Set if the indices have been reordered for the vertex cache.
+  bool optimizedIndexOrder = false;
+  MeshCacheSource source;
+};
+
+// The file starts with this header; vertices and indices follow at the given
+// offsets, each aligned to 16 bytes.
+struct MeshCacheHeader {
+  static const uint32_t MAGIC = 0x4853454d; // "MESH"
+  static const uint32_t VERSION = 2;
+  // Reads differently if the byte order does not match.
+  static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+  static const uint32_t OPTIMIZED_INDEX_ORDER = 1;
+
+  uint32_t magic;
+  uint32_t version;
+  uint32_t byteOrder;
+  uint32_t headerSize;
+  uint32_t vertexSize;
+  uint32_t flags;
+  uint64_t vertexCount;
+  uint64_t vertexOffset;
+  uint64_t indexCount;
+  uint64_t indexOffset;
+  float boundsMin[3];
+  float boundsMax[3];
+  float boundingSphereRadius;
+  uint32_t reserved;
+  uint64_t sourceSize;
+  int64_t sourceMtimeSec;
+  int64_t sourceMtimeNsec;
+};
+
+// Writes vertices and indices to a cache file. Returns false if the file
+// could not be written.
+bool writeMeshCache(const std::string &filename,
+                    const render::VertexBuffer &vertices,
+                    const render::IndexBuffer &indices,
+                    const MeshCacheInfo &info);
+
+// Reads a cache file written by writeMeshCache(). Returns false, and leaves
+// the buffers alone, if the file is missing, was written by an incompatible
+// build, or is truncated or otherwise inconsistent. If expectedSource is
+// given, a cache that was written for a different source is rejected as well.
+bool readMeshCache(const std::string &filename, render::VertexBuffer &vertices,
+                   render::IndexBuffer &indices, MeshCacheInfo &info,
+                   const MeshCacheSource *expectedSource = nullptr);
+
+// Gets the size and modification time of a file. Returns false if the file
+// does not exist.
+bool getMeshCacheSource(const std::string &filename, MeshCacheSource &source);
+
+} // namespace geometry
+
+#endif // GFX1993_MESHCACHE_H
@@ -0,0 +1,239 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+using render::IndexList;
+using render::Vertex;
+using render::VertexList;
+
+namespace geometry {
+
+float computeACMR(const IndexList &indices, size_t vertexCount,
+                  unsigned int cacheSize) {
+  const size_t triangleCount = indices.size() / 3;
+  if (triangleCount == 0)
+    return 0.f;
+
+  // A vertex is in the cache if it entered it fewer than cacheSize misses ago;
+  // cachedAt counts from 1 so that 0 is never.
+  std::vector<size_t> cachedAt(vertexCount, 0);
+  size_t misses = 0;
+  for (size_t i = 0; i < triangleCount * 3; ++i) {
+    const unsigned int v = indices[i];
+    if (cachedAt[v] == 0 || misses - cachedAt[v] >= cacheSize) {
+      ++misses;
+      cachedAt[v] = misses;
+    }
+  }
+  return (float)misses / triangleCount;
+}
+
+void optimizeVertexCache(IndexList &indices, size_t vertexCount,
+                         unsigned int cacheSize,
+                         std::vector<size_t> *clusters) {
+  const size_t triangleCount = indices.size() / 3;
+  if (clusters)
+    clusters->clear();
+  if (triangleCount == 0)
+    return;
+
+  // The triangles of every vertex, in compressed rows, and the number of them
+  // that still have to be emitted.
+  std::vector<unsigned int> firstTriangle(vertexCount + 1, 0);
+  for (size_t i = 0; i < triangleCount * 3; ++i) {
+    ++firstTriangle[indices[i] + 1];
+  }
+  for (size_t v = 0; v < vertexCount; ++v) {
+    firstTriangle[v + 1] += firstTriangle[v];
+  }
+  std::vector<unsigned int> liveTriangles(vertexCount);
+  for (size_t v = 0; v < vertexCount; ++v) {
+    liveTriangles[v] = firstTriangle[v + 1] - firstTriangle[v];
+  }
+
+  std::vector<unsigned int> vertexTriangles(triangleCount * 3);
+  {
+    std::vector<unsigned int> fill(firstTriangle.begin(),
+                                   firstTriangle.end() - 1);
+    for (size_t i = 0; i < triangleCount * 3; ++i) {
+      vertexTriangles[fill[indices[i]]++] = i / 3;
+    }
+  }
+
+  // Cache time stamps: a vertex is in the cache if it entered it less than
+  // cacheSize time steps ago.
+  std::vector<unsigned int> cacheTime(vertexCount, 0);
+  unsigned int time = cacheSize + 1;
+
+  std::vector<bool> emitted(triangleCount, false);
+  std::vector<unsigned int> deadEnds;
+  std::vector<unsigned int> candidates;
+  IndexList output;
+  output.reserve(triangleCount * 3);
+
+  // Fanning vertex; the cursor walks all vertices for the ones left over
+  // when the dead end stack runs dry.
+  long fanning = 0;
+  size_t cursor = 1;
+  bool newCluster = true;
+  while (fanning >= 0) {
+    candidates.clear();
+    for (unsigned int i = firstTriangle[fanning];
+         i < firstTriangle[fanning + 1]; ++i) {
+      const unsigned int t = vertexTriangles[i];
+      if (emitted[t])
+        continue;
+
+      if (newCluster && clusters)
+        clusters->push_back(output.size() / 3);
+      newCluster = false;
+
+      for (int k = 0; k < 3; ++k) {
+        const unsigned int v = indices[t * 3 + k];
+        output.push_back(v);
+        deadEnds.push_back(v);
+        candidates.push_back(v);
+        --liveTriangles[v];
+        if (time - cacheTime[v] > cacheSize) {
+          cacheTime[v] = time++;
+        }
+      }
+      emitted[t] = true;
+    }
+
+    // Next, the candidate that will still be in the cache after fanning
+    // around it, and of those the one that entered it first.
+    long next = -1;
+    long best = -1;
+    for (unsigned int v : candidates) {
+      if (liveTriangles[v] == 0)
+        continue;
+
+      long priority = 0;
+      if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+        priority = time - cacheTime[v];
+      if (priority > best) {
+        best = priority;
+        next = v;
+      }
+    }
+
+    // Otherwise, a vertex that was used recently, or any vertex that is left.
+    // A new cluster only starts if that vertex has left the cache already;
+    // splitting the order anywhere else would give away cached vertices once
+    // the clusters are reordered.
+    if (next < 0) {
+      while (!deadEnds.empty() && next < 0) {
+        const unsigned int v = deadEnds.back();
+        deadEnds.pop_back();
+        if (liveTriangles[v] > 0)
+          next = v;
+      }
+      for (; next < 0 && cursor < vertexCount; ++cursor) {
+        if (liveTriangles[cursor] > 0)
+          next = cursor;
+      }
+      newCluster = next >= 0 && time - cacheTime[next] > cacheSize;
+    }
+    fanning = next;
+  }
+
+  // Leftover indices that do not make up a whole triangle stay at the end.
+  output.insert(output.end(), indices.begin() + triangleCount * 3,
+                indices.end());
+  indices.swap(output);
+}
+
+void optimizeOverdraw(IndexList &indices, const VertexList &vertices,
+                      const std::vector<size_t> &clusters) {
+  const size_t triangleCount = indices.size() / 3;
+  if (clusters.size() < 2)
+    return;
+
+  // Area-weighted centroid and normal of every cluster, and of the mesh.
+  struct Cluster {
+    size_t begin, end;
+    glm::vec3 centroid;
+    glm::vec3 normal;
+    float sortKey;
+  };
+  std::vector<Cluster> sorted;
+  glm::vec3 meshCentroid(0.f);
+  float meshArea = 0.f;
+  for (size_t c = 0; c < clusters.size(); ++c) {
+    Cluster cluster;
+    cluster.begin = clusters[c];
+    cluster.end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+    cluster.centroid = glm::vec3(0.f);
+    cluster.normal = glm::vec3(0.f);
+
+    float area = 0.f;
+    for (size_t t = cluster.begin; t < cluster.end; ++t) {
+      const glm::vec3 a(vertices[indices[t * 3 + 0]].position);
+      const glm::vec3 b(vertices[indices[t * 3 + 1]].position);
+      const glm::vec3 c(vertices[indices[t * 3 + 2]].position);
+      const glm::vec3 n = glm::cross(b - a, c - a);
+      const float triangleArea = glm::length(n);
+      cluster.centroid += (a + b + c) * (triangleArea / 3.f);
+      cluster.normal += n;
+      area += triangleArea;
+    }
+
+    meshCentroid += cluster.centroid;
+    meshArea += area;
+    if (area > 0.f)
+      cluster.centroid /= area;
+    sorted.push_back(cluster);
+  }
+  if (meshArea > 0.f)
+    meshCentroid /= meshArea;
+
+  for (Cluster &cluster : sorted) {
+    const float length = glm::length(cluster.normal);
+    cluster.sortKey =
+        length > 0.f
+            ? glm::dot(cluster.centroid - meshCentroid, cluster.normal) / length
+            : 0.f;
+  }
+  std::stable_sort(sorted.begin(), sorted.end(),
+                   [](const Cluster &a, const Cluster &b) {
+                     return a.sortKey > b.sortKey;
+                   });
+
+  IndexList output;
+  output.reserve(indices.size());
+  for (const Cluster &cluster : sorted) {
+    output.insert(output.end(), indices.begin() + cluster.begin * 3,
+                  indices.begin() + cluster.end * 3);
+  }
+  output.insert(output.end(), indices.begin() + triangleCount * 3,
+                indices.end());
+  indices.swap(output);
+}
+
+size_t optimizeVertexFetch(VertexList &vertices, IndexList &indices) {
+  static const unsigned int UNUSED = ~0u;
+  std::vector<unsigned int> newIndex(vertices.size(), UNUSED);
+
+  VertexList output;
+  output.reserve(vertices.size());
+  for (unsigned int &index : indices) {
+    if (newIndex[index] == UNUSED) {
+      newIndex[index] = output.size();
+      output.push_back(vertices[index]);
+    }
+    index = newIndex[index];
+  }
+
+  const size_t usedVertices = output.size();
+  for (size_t v = 0; v < vertices.size(); ++v) {
+    if (newIndex[v] == UNUSED)
+      output.push_back(vertices[v]);
+  }
+  vertices.swap(output);
+  return usedVertices;
+}
+
+} // namespace geometry
@@ -0,0 +1,58 @@
+#ifndef GFX1993_MESHOPTIMIZER_H
+#define GFX1993_MESHOPTIMIZER_H
+
+#include <cstddef>
+#include <vector>
+
+#include "../rendering/Pipeline.h"
+
+namespace geometry {
+
+// Reordering of triangle meshes for locality: triangles for the reuse of
+// recently transformed vertices, vertices for the order in which they are
+// fetched, and optionally clusters of triangles for less overdraw. None of it
+// changes the mesh itself, nor the winding of its triangles.
+
+// Size of the FIFO vertex cache the reordering optimizes for and the average
+// cache miss ratio is measured with.
+static const unsigned int DEFAULT_VERTEX_CACHE_SIZE = 32;
+
+// Average cache miss ratio: the number of vertices a FIFO cache of the given
+// size misses per triangle when the triangles are drawn in order. Ranges from
+// about 0.5 for a perfect order of a large regular mesh to 3 for no reuse at
+// all.
+float computeACMR(const render::IndexList &indices, size_t vertexCount,
+                  unsigned int cacheSize = DEFAULT_VERTEX_CACHE_SIZE);
+
+// Reorders the triangles for a vertex cache of the given size, with the
+// Tipsify algorithm of Sander et al., "Fast Triangle Reordering for Vertex
+// Locality and Reduced Overdraw" (2007): it fans around one vertex after
+// another, picking as the next one a vertex of the last triangles that will
+// still be in the cache. Runs in linear time.
+//
+// If clusters is given, it receives the index of the first triangle of each
+// run of triangles that starts fanning around a vertex which is no longer in
+// the cache. These clusters can be reordered at little cost to cache
+// efficiency, though vertices of a cluster's first triangles may still be
+// cached from the one before it.
+void optimizeVertexCache(render::IndexList &indices, size_t vertexCount,
+                         unsigned int cacheSize = DEFAULT_VERTEX_CACHE_SIZE,
+                         std::vector<size_t> *clusters = nullptr);
+
+// Reorders the clusters of triangles from optimizeVertexCache() so that the
+// ones facing away from the center of the mesh come first. Drawn from most
+// views, these tend to cover the others, so fewer fragments get shaded only
+// to be overwritten.
+void optimizeOverdraw(render::IndexList &indices,
+                      const render::VertexList &vertices,
+                      const std::vector<size_t> &clusters);
+
+// Reorders the vertices in the order the triangles first use them and
+// renumbers the indices. Vertices that no triangle uses go to the end. Returns
+// the number of vertices that are used.
+size_t optimizeVertexFetch(render::VertexList &vertices,
+                         render::IndexList &indices);
+
+} // namespace geometry
+
+#endif // GFX1993_MESHOPTIMIZER_H
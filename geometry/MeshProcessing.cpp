@@ -0,0 +1,98 @@
+#include "MeshProcessing.h"
+
+#include <cassert>
+#include <cfloat>
+#include <utility>
+
+using glm::vec3;
+using render::Vertex;
+
+namespace geometry {
+
+void computeBounds(render::WorkerPool &pool,
+                   const render::VertexBuffer &vertices, vec3 &min,
+                   vec3 &max) {
+  if (vertices.empty()) {
+    min = max = vec3(0.f);
+    return;
+  }
+
+  typedef std::pair<vec3, vec3> Bounds;
+  const Bounds bounds = parallelReduce(
+      pool, vertices.size(), Bounds(vec3(FLT_MAX), vec3(-FLT_MAX)),
+      [&](size_t i) {
+        const vec3 p(vertices[i].position);
+        return Bounds(p, p);
+      },
+      [](const Bounds &a, const Bounds &b) {
+        return Bounds(glm::min(a.first, b.first), glm::max(a.second, b.second));
+      });
+  min = bounds.first;
+  max = bounds.second;
+}
+
+float computeBoundingSphereRadius(render::WorkerPool &pool,
+                                  const render::VertexBuffer &vertices) {
+  return parallelReduce(
+      pool, vertices.size(), 0.f,
+      [&](size_t i) { return glm::length(vec3(vertices[i].position)); },
+      [](float a, float b) { return std::max(a, b); });
+}
+
+void translate(render::WorkerPool &pool, render::VertexBuffer &vertices,
+               const vec3 &offset) {
+  Vertex *data = vertices.data();
+  parallelForEach(pool, vertices.size(), [&](size_t i) {
+    data[i].position += glm::vec4(offset, 0.f);
+  });
+}
+
+void computeVertexNormals(render::WorkerPool &pool,
+                          render::VertexBuffer &vertices,
+                          const render::IndexBuffer &indices) {
+  assert(indices.getRequiredVertexCount() <= vertices.size());
+
+  const size_t vertexCount = vertices.size();
+  const size_t triangleCount = indices.size() / 3;
+  Vertex *data = vertices.data();
+
+  // Unit normals of the triangles; zero for degenerate ones.
+  std::vector<vec3> triangleNormals(triangleCount);
+  parallelForEach(pool, triangleCount, [&](size_t t) {
+    const vec3 a(data[indices[t * 3 + 0]].position);
+    const vec3 b(data[indices[t * 3 + 1]].position);
+    const vec3 c(data[indices[t * 3 + 2]].position);
+    const vec3 n = glm::cross(b - a, c - a);
+    const float length = glm::length(n);
+    triangleNormals[t] = length > 0.f ? n / length : vec3(0.f);
+  });
+
+  // The triangles of every vertex, in compressed rows: the triangles of
+  // vertex v are firstTriangle[v] to firstTriangle[v + 1] in vertexTriangles.
+  // Building it is a couple of linear passes over the indices.
+  std::vector<unsigned int> firstTriangle(vertexCount + 1, 0);
+  for (size_t i = 0; i < triangleCount * 3; ++i) {
+    ++firstTriangle[indices[i] + 1];
+  }
+  for (size_t v = 0; v < vertexCount; ++v) {
+    firstTriangle[v + 1] += firstTriangle[v];
+  }
+
+  std::vector<unsigned int> vertexTriangles(triangleCount * 3);
+  std::vector<unsigned int> fill(firstTriangle.begin(),
+                                 firstTriangle.end() - 1);
+  for (size_t i = 0; i < triangleCount * 3; ++i) {
+    vertexTriangles[fill[indices[i]]++] = i / 3;
+  }
+
+  parallelForEach(pool, vertexCount, [&](size_t v) {
+    vec3 n(0.f);
+    for (unsigned int i = firstTriangle[v]; i < firstTriangle[v + 1]; ++i) {
+      n += triangleNormals[vertexTriangles[i]];
+    }
+    const float length = glm::length(n);
+    data[v].normal = length > 0.f ? n / length : vec3(0.f);
+  });
+}
+
+} // namespace geometry
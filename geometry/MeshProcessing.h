@@ -0,0 +1,91 @@
+#ifndef GFX1993_MESHPROCESSING_H
+#define GFX1993_MESHPROCESSING_H
+
+#include <algorithm>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "../rendering/VertexBuffer.h"
+#include "../rendering/WorkerPool.h"
+
+namespace geometry {
+
+// Preprocessing of triangle meshes after loading. All of it runs on a worker
+// pool; with a pool of a single thread, it runs inline.
+
+// Number of contiguous chunks parallelForEach() and parallelReduce() split
+// count items into: a few per thread, so that uneven chunks even out, but
+// none too small to be worth a job.
+inline size_t getChunkCount(const render::WorkerPool &pool, size_t count) {
+  static const size_t MIN_CHUNK_SIZE = 4096;
+  return std::max<size_t>(
+      1, std::min<size_t>(pool.getThreadCount() * 4, count / MIN_CHUNK_SIZE));
+}
+
+// Calls fn(i) for every i in [0, count), chunk by chunk on the pool.
+template <typename Fn>
+void parallelForEach(render::WorkerPool &pool, size_t count, const Fn &fn) {
+  const size_t chunkCount = getChunkCount(pool, count);
+  const size_t chunkSize = (count + chunkCount - 1) / chunkCount;
+
+  pool.parallelFor(chunkCount, [&](size_t chunk) {
+    const size_t end = std::min(count, (chunk + 1) * chunkSize);
+    for (size_t i = chunk * chunkSize; i < end; ++i) {
+      fn(i);
+    }
+  });
+}
+
+// Reduces map(i) for i in [0, count) with combine: every chunk is reduced on
+// its own, and the partial results are combined in chunk order at the end.
+template <typename T, typename Map, typename Combine>
+T parallelReduce(render::WorkerPool &pool, size_t count, const T &identity,
+                 const Map &map, const Combine &combine) {
+  const size_t chunkCount = getChunkCount(pool, count);
+  const size_t chunkSize = (count + chunkCount - 1) / chunkCount;
+
+  std::vector<T> partials(chunkCount, identity);
+  pool.parallelFor(chunkCount, [&](size_t chunk) {
+    T result = identity;
+    const size_t end = std::min(count, (chunk + 1) * chunkSize);
+    for (size_t i = chunk * chunkSize; i < end; ++i) {
+      result = combine(result, map(i));
+    }
+    partials[chunk] = result;
+  });
+
+  T result = identity;
+  for (const T &partial : partials) {
+    result = combine(result, partial);
+  }
+  return result;
+}
+
+// Axis-aligned bounding box of the vertex positions. Both corners are zero
+// for an empty buffer.
+void computeBounds(render::WorkerPool &pool,
+                   const render::VertexBuffer &vertices, glm::vec3 &min,
+                   glm::vec3 &max);
+
+// Largest distance of a vertex position from the origin.
+float computeBoundingSphereRadius(render::WorkerPool &pool,
+                                  const render::VertexBuffer &vertices);
+
+// Moves all vertex positions by offset.
+void translate(render::WorkerPool &pool, render::VertexBuffer &vertices,
+               const glm::vec3 &offset);
+
+// Sets the normal of every vertex to the normalized sum of the normals of the
+// triangles that use it. Each vertex gathers its triangles from a vertex to
+// triangle adjacency table, so no two threads ever write to the same normal
+// and the sums come out the same whatever the thread count. Vertices that are
+// not part of any proper triangle get a zero normal. Every index has to refer
+// to one of the vertices.
+void computeVertexNormals(render::WorkerPool &pool,
+                          render::VertexBuffer &vertices,
+                          const render::IndexBuffer &indices);
+
+} // namespace geometry
+
+#endif // GFX1993_MESHPROCESSING_H
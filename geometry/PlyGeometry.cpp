@@ -1,141 +1,559 @@
 #include "PlyGeometry.h"
+#include "MeshCache.h"
+#include "MeshProcessing.h"
+#include "../rendering/MappedFile.h"
 #include "../rendering/Pipeline.h"
 
 #include <algorithm>
-#include <cassert>
-#include <cstdio>
-#include <fstream>
+#include <cctype>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
 #include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <utility>
+#include <vector>
 
 using render::Vertex;
 
 namespace geometry {
 
-PlyGeometry::PlyGeometry() : boundingSphereRadius(0) {}
-
-bool PlyGeometry::loadPly(const std::string &filename) {
-  boundingSphereRadius = 0.f;
+namespace {
+
+enum class PlyFormat { ASCII, BINARY_LITTLE_ENDIAN, BINARY_BIG_ENDIAN };
+
+enum class PlyType {
+  INT8,
+  UINT8,
+  INT16,
+  UINT16,
+  INT32,
+  UINT32,
+  FLOAT32,
+  FLOAT64
+};
+
+// What a vertex property is loaded into.
+enum class VertexAttribute { NONE, X, Y, Z, NX, NY, NZ, R, G, B, A, U, V };
+
+// A property as declared in the header. List properties store their length
+// as countType, followed by that many values of type.
+struct PlyProperty {
+  std::string name;
+  PlyType type;
+  bool list = false;
+  PlyType countType;
+};
+
+struct PlyElement {
+  std::string name;
+  size_t count = 0;
+  std::vector<PlyProperty> properties;
+};
+
+bool parseType(const std::string &name, PlyType &type) {
+  static const struct {
+    const char *name;
+    PlyType type;
+  } types[] = {{"char", PlyType::INT8},      {"int8", PlyType::INT8},
+               {"uchar", PlyType::UINT8},    {"uint8", PlyType::UINT8},
+               {"short", PlyType::INT16},    {"int16", PlyType::INT16},
+               {"ushort", PlyType::UINT16},  {"uint16", PlyType::UINT16},
+               {"int", PlyType::INT32},      {"int32", PlyType::INT32},
+               {"uint", PlyType::UINT32},    {"uint32", PlyType::UINT32},
+               {"float", PlyType::FLOAT32},  {"float32", PlyType::FLOAT32},
+               {"double", PlyType::FLOAT64}, {"float64", PlyType::FLOAT64}};
+
+  for (const auto &t : types) {
+    if (name == t.name) {
+      type = t.type;
+      return true;
+    }
+  }
+  return false;
+}
 
-  std::ifstream file(filename.c_str());
-  if (!file.is_open()) {
-    std::cerr << "Unable to open file \"" << filename << "\"\n";
-    return false;
-  } else
-    std::clog << "Loading file " << filename << std::endl;
+VertexAttribute getVertexAttribute(const std::string &name) {
+  static const struct {
+    const char *name;
+    VertexAttribute attribute;
+  } attributes[] = {
+      {"x", VertexAttribute::X},         {"y", VertexAttribute::Y},
+      {"z", VertexAttribute::Z},         {"nx", VertexAttribute::NX},
+      {"ny", VertexAttribute::NY},       {"nz", VertexAttribute::NZ},
+      {"red", VertexAttribute::R},       {"green", VertexAttribute::G},
+      {"blue", VertexAttribute::B},      {"alpha", VertexAttribute::A},
+      {"u", VertexAttribute::U},         {"v", VertexAttribute::V},
+      {"s", VertexAttribute::U},         {"t", VertexAttribute::V},
+      {"texture_u", VertexAttribute::U}, {"texture_v", VertexAttribute::V}};
+
+  for (const auto &a : attributes) {
+    if (name == a.name)
+      return a.attribute;
+  }
+  return VertexAttribute::NONE;
+}
 
-  std::string buffer;
+// Scale that maps the range of an integer color channel to [0, 1].
+float getColorScale(PlyType type) {
+  switch (type) {
+  case PlyType::UINT8:
+    return 1.f / UINT8_MAX;
+  case PlyType::UINT16:
+    return 1.f / UINT16_MAX;
+  default:
+    return 1.f;
+  }
+}
 
-  bool readHeader = true;
-  unsigned int vertexCount = 0, readVertices = 0;
-  unsigned int faceCount = 0;
-  while (!file.eof()) {
-    std::getline(file, buffer);
+inline size_t getTypeSize(PlyType type) {
+  static const size_t sizes[] = {1, 1, 2, 2, 4, 4, 4, 8};
+  return sizes[(int)type];
+}
 
-    if (buffer.empty())
-      continue;
+template <typename T>
+inline double load(const unsigned char *p, bool swapBytes) {
+  unsigned char bytes[sizeof(T)];
+  memcpy(bytes, p, sizeof(T));
+  if (swapBytes)
+    std::reverse(bytes, bytes + sizeof(T));
+  T value;
+  memcpy(&value, bytes, sizeof(T));
+  return value;
+}
 
-    if (readHeader) {
-      if (buffer == "end_header")
-        readHeader = false;
+// Reads the values of the body, in place from the mapped file. Reading past
+// the end of the file, or a malformed ASCII value, clears ok and returns 0.
+class PlyReader {
+public:
+  PlyReader(const unsigned char *begin, const unsigned char *end,
+            PlyFormat format)
+      : p(begin), end(end), format(format) {
+    const uint16_t probe = 1;
+    const bool littleEndianHost =
+        *reinterpret_cast<const unsigned char *>(&probe) == 1;
+    swapBytes = (format == PlyFormat::BINARY_BIG_ENDIAN) == littleEndianHost;
+  }
 
-      if (buffer.find("element vertex") != std::string::npos) {
-        assert(sscanf(buffer.c_str(), "element vertex %i", &vertexCount) == 1);
-        vertices.reserve(vertexCount);
-      }
+  inline double read(PlyType type) {
+    if (format == PlyFormat::ASCII)
+      return readAscii();
 
-      if (buffer.find("element face") != std::string::npos) {
-        assert(sscanf(buffer.c_str(), "element face %i", &faceCount) == 1);
-        indices.reserve(faceCount * 3);
-      }
+    const size_t size = getTypeSize(type);
+    if ((size_t)(end - p) < size) {
+      ok = false;
+      return 0.;
+    }
 
-      continue;
+    const unsigned char *value = p;
+    p += size;
+    switch (type) {
+    case PlyType::INT8:
+      return load<int8_t>(value, false);
+    case PlyType::UINT8:
+      return load<uint8_t>(value, false);
+    case PlyType::INT16:
+      return load<int16_t>(value, swapBytes);
+    case PlyType::UINT16:
+      return load<uint16_t>(value, swapBytes);
+    case PlyType::INT32:
+      return load<int32_t>(value, swapBytes);
+    case PlyType::UINT32:
+      return load<uint32_t>(value, swapBytes);
+    case PlyType::FLOAT32:
+      return load<float>(value, swapBytes);
+    default:
+      return load<double>(value, swapBytes);
     }
+  }
 
-    // read number of vertices
-    if (readVertices < vertexCount) {
-      float x, y, z, c, i;
-      assert(sscanf(buffer.c_str(), "%f %f %f %f %f", &x, &y, &z, &c, &i) == 5);
+  // Reads a whole property and returns its value, or the length of a list.
+  // List items are skipped.
+  inline double read(const PlyProperty &property) {
+    if (!property.list)
+      return read(property.type);
 
-      vertices.push_back(Vertex(glm::vec4(x, y, z, 1)));
+    const unsigned int count = readIndex(property.countType);
+    for (unsigned int i = 0; i < count && ok; ++i)
+      read(property.type);
+    return count;
+  }
 
-      boundingSphereRadius =
-          std::max(boundingSphereRadius, sqrtf(x * x + y * y + z * z));
+  // Reads a list length or a vertex index. Negative values and ones that do
+  // not fit in an unsigned int clear ok and return 0.
+  inline unsigned int readIndex(PlyType type) {
+    const double value = read(type);
+    if (!(value >= 0. && value <= UINT_MAX)) {
+      ok = false;
+      return 0;
+    }
+    return (unsigned int)value;
+  }
 
-      ++readVertices;
+  // Bytes left to read.
+  inline size_t getRemaining() const { return end - p; }
+
+  bool ok = true;
+
+private:
+  const unsigned char *p;
+  const unsigned char *end;
+  PlyFormat format;
+  bool swapBytes;
+
+  double readAscii() {
+    while (p != end && isspace(*p))
+      ++p;
+
+    // Copied out for strtod, which needs a terminated string.
+    char token[64];
+    size_t length = 0;
+    while (p != end && !isspace(*p) && length + 1 < sizeof(token))
+      token[length++] = *p++;
+    token[length] = '\0';
+
+    char *tokenEnd;
+    const double value = strtod(token, &tokenEnd);
+    if (length == 0 || tokenEnd != token + length) {
+      ok = false;
+      return 0.;
     }
+    return value;
+  }
+};
+
+// Calls fn with the worker threads for preprocessing. They are shared by all
+// PLY geometries and started on first use, so loading many meshes does not
+// start new threads every time. A pool runs one batch of jobs at a time;
+// geometries loaded on several threads take turns.
+void withWorkers(const std::function<void(render::WorkerPool &)> &fn) {
+  static std::mutex mutex;
+  static render::WorkerPool workers(std::thread::hardware_concurrency());
+  std::lock_guard<std::mutex> lock(mutex);
+  fn(workers);
+}
 
-    // and then the faces
-    else {
-      unsigned int a, b, c;
-      assert(sscanf(buffer.c_str(), "3 %i %i %i", &a, &b, &c) == 3);
+// The fewest bytes an element can take up in the body: the sizes of its
+// values, lists being empty, or a digit and a separator per value in ASCII.
+size_t getMinimumSize(const PlyElement &element, PlyFormat format) {
+  size_t size = 0;
+  for (const PlyProperty &property : element.properties) {
+    if (format == PlyFormat::ASCII)
+      size += 2;
+    else
+      size += getTypeSize(property.list ? property.countType : property.type);
+  }
+  return size;
+}
 
-      indices.push_back(a);
-      indices.push_back(b);
-      indices.push_back(c);
+// Number of elements to reserve memory for: the count from the header, unless
+// the rest of the file is too small to hold that many.
+size_t getPlausibleCount(const PlyElement &element, PlyFormat format,
+                         const PlyReader &reader) {
+  const size_t size = getMinimumSize(element, format);
+  return size == 0 ? 0 : std::min(element.count, reader.getRemaining() / size);
+}
 
-      if (a >= vertices.size())
-        std::cerr << "Illegal index: " << a << "?\n";
+// Parses the header; body is set to the first byte after it.
+bool parseHeader(const unsigned char *data, size_t size, PlyFormat &format,
+                 std::vector<PlyElement> &elements,
+                 const unsigned char *&body) {
+  const unsigned char *p = data;
+  const unsigned char *end = data + size;
+  bool hasFormat = false;
+
+  for (bool firstLine = true;; firstLine = false) {
+    const unsigned char *lineEnd =
+        static_cast<const unsigned char *>(memchr(p, '\n', end - p));
+    if (!lineEnd)
+      return false;
+    std::istringstream line(std::string(p, lineEnd));
+    p = lineEnd + 1;
+
+    std::string keyword;
+    line >> keyword;
+    if (firstLine) {
+      if (keyword != "ply")
+        return false;
+      continue;
+    }
 
-      if (b >= vertices.size())
-        std::cerr << "Illegal index: " << b << "?\n";
+    if (keyword == "end_header") {
+      body = p;
+      return hasFormat;
+    }
 
-      if (c >= vertices.size())
-        std::cerr << "Illegal index: " << c << "?\n";
+    if (keyword == "format") {
+      std::string name;
+      line >> name;
+      if (name == "ascii")
+        format = PlyFormat::ASCII;
+      else if (name == "binary_little_endian")
+        format = PlyFormat::BINARY_LITTLE_ENDIAN;
+      else if (name == "binary_big_endian")
+        format = PlyFormat::BINARY_BIG_ENDIAN;
+      else
+        return false;
+      hasFormat = true;
+    } else if (keyword == "element") {
+      PlyElement element;
+      if (!(line >> element.name >> element.count))
+        return false;
+      elements.push_back(element);
+    } else if (keyword == "property") {
+      if (elements.empty())
+        return false;
+
+      PlyProperty property;
+      std::string type;
+      line >> type;
+      if (type == "list") {
+        std::string countType;
+        line >> countType >> type;
+        property.list = true;
+        if (!parseType(countType, property.countType))
+          return false;
+      }
+      if (!parseType(type, property.type) || !(line >> property.name))
+        return false;
+      elements.back().properties.push_back(property);
     }
+    // Anything else is a comment or obj_info.
   }
+}
 
-  std::clog << "Read " << vertices.size() << " vertices, " << indices.size()
-            << " indices" << std::endl;
+} // namespace
 
-  // calculate normals
-  for (size_t i = 0; i < indices.size(); i += 3) {
+PlyGeometry::PlyGeometry() : boundingSphereRadius(0) {}
 
-    // triangle
-    Vertex &a = vertices[indices[i + 0]];
-    Vertex &b = vertices[indices[i + 1]];
-    Vertex &c = vertices[indices[i + 2]];
+bool PlyGeometry::loadPly(const std::string &filename) {
+  // Taken before reading, so that a file changed in between makes the cache
+  // stale rather than matching.
+  MeshCacheSource loadedSource;
+  getMeshCacheSource(filename, loadedSource);
 
-    // normal
-    glm::vec3 n =
-        glm::normalize(glm::cross(glm::vec3(b.position - a.position),
-                                  glm::vec3(c.position - a.position)));
+  const render::MappedFile file(filename);
+  if (!file.isOpen()) {
+    std::cerr << "Unable to open file \"" << filename << "\"\n";
+    return false;
+  } else
+    std::clog << "Loading file " << filename << std::endl;
 
-    a.normal += n;
-    b.normal += n;
-    c.normal += n;
+  PlyFormat format;
+  std::vector<PlyElement> elements;
+  const unsigned char *body;
+  if (!parseHeader(file.getData(), file.getSize(), format, elements, body)) {
+    std::cerr << "Invalid PLY header in \"" << filename << "\"\n";
+    return false;
   }
 
-  std::clog << "Renormalizing " << vertices.size() << " vertex normals."
-            << std::endl;
-  // scale normal to length 1;
-  for (auto v : vertices) {
-    v.normal = glm::normalize(v.normal);
+  // Indices refer to the vertex element, wherever it is in the file.
+  size_t vertexCount = 0;
+  for (const PlyElement &element : elements) {
+    if (element.name == "vertex")
+      vertexCount = element.count;
   }
 
-  return true;
-}
+  // Read into buffers of their own; the geometry only changes once the whole
+  // file has been read.
+  VertexBuffer loadedVertices;
+  IndexBuffer loadedIndices;
+
+  PlyReader reader(body, file.getData() + file.getSize(), format);
+  bool hasNormals = false;
+  for (const PlyElement &element : elements) {
+    const std::vector<PlyProperty> &properties = element.properties;
+
+    if (element.name == "vertex") {
+      std::vector<VertexAttribute> attributes;
+      for (const PlyProperty &property : properties) {
+        attributes.push_back(property.list ? VertexAttribute::NONE
+                                           : getVertexAttribute(property.name));
+        hasNormals = hasNormals || attributes.back() == VertexAttribute::NX;
+      }
 
-void PlyGeometry::center() {
-  // find bounding box
-  glm::vec3 min(FLT_MAX), max(FLT_MIN);
+      loadedVertices.reserve(loadedVertices.size() +
+                             getPlausibleCount(element, format, reader));
+      for (size_t i = 0; i < element.count && reader.ok; ++i) {
+        Vertex v(glm::vec4(0, 0, 0, 1));
+        for (size_t j = 0; j < properties.size(); ++j) {
+          const float value = reader.read(properties[j]);
+          const float color = value * getColorScale(properties[j].type);
+          switch (attributes[j]) {
+          case VertexAttribute::X:
+            v.position.x = value;
+            break;
+          case VertexAttribute::Y:
+            v.position.y = value;
+            break;
+          case VertexAttribute::Z:
+            v.position.z = value;
+            break;
+          case VertexAttribute::NX:
+            v.normal.x = value;
+            break;
+          case VertexAttribute::NY:
+            v.normal.y = value;
+            break;
+          case VertexAttribute::NZ:
+            v.normal.z = value;
+            break;
+          case VertexAttribute::R:
+            v.color.r = color;
+            break;
+          case VertexAttribute::G:
+            v.color.g = color;
+            break;
+          case VertexAttribute::B:
+            v.color.b = color;
+            break;
+          case VertexAttribute::A:
+            v.color.a = color;
+            break;
+          case VertexAttribute::U:
+            v.texcoord.x = value;
+            break;
+          case VertexAttribute::V:
+            v.texcoord.y = value;
+            break;
+          default:
+            break;
+          }
+        }
+
+        loadedVertices.push_back(v);
+      }
+    } else if (element.name == "face") {
+      size_t indexProperty = properties.size();
+      for (size_t j = 0; j < properties.size(); ++j) {
+        if (properties[j].list && (properties[j].name == "vertex_indices" ||
+                                   properties[j].name == "vertex_index"))
+          indexProperty = j;
+      }
+      if (indexProperty == properties.size()) {
+        std::cerr << "No vertex indices in \"" << filename << "\"\n";
+        return false;
+      }
 
-  for (auto v : vertices) {
-    min.x = std::min(min.x, v.position.x);
-    min.y = std::min(min.y, v.position.y);
-    min.z = std::min(min.z, v.position.z);
+      loadedIndices.reserve(loadedIndices.size() +
+                            getPlausibleCount(element, format, reader) * 3);
+      for (size_t i = 0; i < element.count && reader.ok; ++i) {
+        for (size_t j = 0; j < properties.size(); ++j) {
+          if (j != indexProperty) {
+            reader.read(properties[j]);
+            continue;
+          }
+
+          // Polygons are split into a fan of triangles.
+          const PlyProperty &property = properties[j];
+          const unsigned int count = reader.readIndex(property.countType);
+          unsigned int first = 0, previous = 0;
+          for (unsigned int k = 0; k < count && reader.ok; ++k) {
+            const unsigned int index = reader.readIndex(property.type);
+            if (reader.ok && index >= vertexCount) {
+              std::cerr << "Illegal index: " << index << "?\n";
+              return false;
+            }
+
+            if (k == 0) {
+              first = index;
+            } else if (k >= 2) {
+              loadedIndices.push_back(first);
+              loadedIndices.push_back(previous);
+              loadedIndices.push_back(index);
+            }
+            previous = index;
+          }
+        }
+      }
+    } else {
+      for (size_t i = 0; i < element.count && reader.ok; ++i) {
+        for (const PlyProperty &property : properties)
+          reader.read(property);
+      }
+    }
+  }
 
-    max.x = std::max(max.x, v.position.x);
-    max.y = std::max(max.y, v.position.y);
-    max.z = std::max(max.z, v.position.z);
+  if (!reader.ok) {
+    std::cerr << "Invalid or truncated data in \"" << filename << "\"\n";
+    return false;
   }
 
-  // update vertices and find new bounding sphere radius
-  boundingSphereRadius = 0.f;
-  for (auto v : vertices) {
-    v.position =
-        v.position - glm::vec4(min, 0.f) - glm::vec4((max - min) * 0.5f, 0.f);
-    boundingSphereRadius =
-        std::max(boundingSphereRadius, glm::length(glm::vec3(v.position)));
+  std::clog << "Read " << loadedVertices.size() << " vertices, "
+            << loadedIndices.size() << " indices" << std::endl;
+
+  withWorkers([&](render::WorkerPool &pool) {
+    boundingSphereRadius = computeBoundingSphereRadius(pool, loadedVertices);
+
+    // Files with normals keep theirs.
+    if (!hasNormals)
+      computeVertexNormals(pool, loadedVertices, loadedIndices);
+  });
+
+  vertices = std::move(loadedVertices);
+  indices = std::move(loadedIndices);
+  optimized = false;
+  source = loadedSource;
+  return true;
+}
+
+bool PlyGeometry::loadPly(const std::string &filename,
+                          const std::string &cacheFilename) {
+  // Without the PLY file, any cache of it is better than nothing.
+  MeshCacheSource current;
+  const bool hasSource = getMeshCacheSource(filename, current);
+  if (readCache(cacheFilename, hasSource ? &current : nullptr)) {
+    std::clog << "Loaded " << filename << " from " << cacheFilename
+              << std::endl;
+    return true;
   }
+
+  if (!loadPly(filename))
+    return false;
+
+  const OptimizationReport report = optimize();
+  std::clog << "Reordered triangles, ACMR " << report.acmrBefore << " -> "
+            << report.acmrAfter << std::endl;
+
+  if (!writeCache(cacheFilename))
+    std::cerr << "Unable to write cache file \"" << cacheFilename << "\"\n";
+  return true;
+}
+
+bool PlyGeometry::readCache(const std::string &cacheFilename,
+                            const MeshCacheSource *expectedSource) {
+  MeshCacheInfo info;
+  if (!readMeshCache(cacheFilename, vertices, indices, info, expectedSource))
+    return false;
+
+  boundingSphereRadius = info.boundingSphereRadius;
+  optimized = info.optimizedIndexOrder;
+  source = info.source;
+  return true;
+}
+
+bool PlyGeometry::writeCache(const std::string &cacheFilename) const {
+  MeshCacheInfo info;
+  info.boundsMin = vertices.getBoundsMin();
+  info.boundsMax = vertices.getBoundsMax();
+  info.boundingSphereRadius = boundingSphereRadius;
+  info.optimizedIndexOrder = optimized;
+  info.source = source;
+  return writeMeshCache(cacheFilename, vertices, indices, info);
+}
+
+void PlyGeometry::center() {
+  withWorkers([&](render::WorkerPool &pool) {
+    // Move the center of the bounding box to the origin.
+    glm::vec3 min, max;
+    computeBounds(pool, vertices, min, max);
+    translate(pool, vertices, -(min + max) * 0.5f);
+
+    boundingSphereRadius = computeBoundingSphereRadius(pool, vertices);
+  });
+}
 }
-}
\ No newline at end of file
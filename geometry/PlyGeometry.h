@@ -2,6 +2,7 @@
 #define PLY_GEOMETRY_INCLUDED
 
 #include "Geometry.h"
+#include "MeshCache.h"
 
 #include <string>
 
@@ -13,11 +14,28 @@ public:
 
   bool loadPly(const std::string &filename);
 
+  // Loads the geometry from a cache file written by writeCache() if there is
+  // one for the current size and modification time of the PLY file. Otherwise
+  // loads the PLY file, optimizes it and writes the cache for the next time;
+  // failing to write it only gives a warning.
+  bool loadPly(const std::string &filename, const std::string &cacheFilename);
+
+  // Reads and writes the geometry as a mesh cache, see MeshCache.h. The cache
+  // records which state of the PLY file it was made from; if expectedSource
+  // is given, a cache made from anything else is not read.
+  bool readCache(const std::string &cacheFilename,
+                 const MeshCacheSource *expectedSource = nullptr);
+  bool writeCache(const std::string &cacheFilename) const;
+
+  inline float getBoundingSphereRadius() const { return boundingSphereRadius; }
+
   // Centers the geometry without changing the transform.
   void center();
 
 private:
   float boundingSphereRadius;
+  // The PLY file the geometry was loaded from.
+  MeshCacheSource source;
 };
 
 } // namespace geometry
@@ -47,7 +47,7 @@ void RandomTriangleGeometry::clear() {
   vertices.clear();
 }
 
-Vertex &&RandomTriangleGeometry::createRandomVertex() const {
+Vertex RandomTriangleGeometry::createRandomVertex() const {
   vec3 pos = glm::linearRand(boundsMin, boundsMax);
   vec3 normal = glm::ballRand(1.f);
 
@@ -57,8 +57,8 @@ Vertex &&RandomTriangleGeometry::createRandomVertex() const {
   float g = (float)std::rand() / RAND_MAX;
   float b = 1.f - r - g;
 
-  return std::move(
-      Vertex(glm::vec4(pos, 1.f), normal, glm::vec4(r, g, b, 1.f), texcoord));
+  return Vertex(glm::vec4(pos, 1.f), normal, glm::vec4(r, g, b, 1.f),
+                texcoord);
 }
 
 }
\ No newline at end of file
@@ -0,0 +1,47 @@
+#ifndef GFX1993_BUFFERLAYOUT_H
+#define GFX1993_BUFFERLAYOUT_H
+
+namespace render {
+
+// Width and height of the square pixel tiles the frame and depth buffers, and
+// optionally the uncompressed textures, are organized in.
+static const int BUFFER_TILE_SIZE = 8;
+
+// Order in which the frame and depth buffers and the textures store their
+// pixels.
+enum class BufferLayout {
+  // Row by row.
+  LINEAR,
+  // Tile by tile, each tile row by row. The tiles of a row of tiles follow
+  // each other, and the rows of tiles are stored top to bottom; the buffer is
+  // padded to whole tiles. Pixels that are close on screen are close in
+  // memory, too, which suits the block-wise walk of the rasterizer.
+  TILED
+};
+
+// Index of pixel x, y in a buffer of the given layout; tilesX is the number of
+// tiles per row.
+inline unsigned int getBufferIndex(BufferLayout layout, unsigned int x,
+                                   unsigned int y, unsigned int width,
+                                   unsigned int tilesX) {
+  if (layout == BufferLayout::LINEAR)
+    return x + width * y;
+
+  const unsigned int tile =
+      x / BUFFER_TILE_SIZE + tilesX * (y / BUFFER_TILE_SIZE);
+  return tile * BUFFER_TILE_SIZE * BUFFER_TILE_SIZE +
+         y % BUFFER_TILE_SIZE * BUFFER_TILE_SIZE + x % BUFFER_TILE_SIZE;
+}
+
+// Number of pixels a buffer of the given layout stores.
+inline unsigned int getBufferSize(BufferLayout layout, unsigned int width,
+                                  unsigned int height, unsigned int tilesX,
+                                  unsigned int tilesY) {
+  if (layout == BufferLayout::LINEAR)
+    return width * height;
+  return tilesX * tilesY * BUFFER_TILE_SIZE * BUFFER_TILE_SIZE;
+}
+
+} // namespace render
+
+#endif // GFX1993_BUFFERLAYOUT_H
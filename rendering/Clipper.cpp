@@ -1,5 +1,6 @@
 #include "Clipper.h"
 #include <algorithm>
+#include <cassert>
 #include <iostream>
 #include <map>
 
@@ -54,20 +55,13 @@ PointPrimitiveList Clipper::clipPoints(const PointPrimitiveList &points) const {
   return clipped;
 }
 
-inline static bool insideNDC(const glm::vec4 &clipCoords) {
-  return clipCoords.x >= -clipCoords.w && clipCoords.x <= clipCoords.w &&
-         clipCoords.y >= -clipCoords.w && clipCoords.y <= clipCoords.w &&
-         clipCoords.z >= -clipCoords.w && clipCoords.z <= clipCoords.w &&
-         clipCoords.w > 0;
-}
-
 PointPrimitiveList
 Clipper::clipPointsToNdc(const PointPrimitiveList &points) const {
   PointPrimitiveList clipped;
   clipped.reserve(points.size());
 
   for (const PointPrimitive &p : points) {
-    if (insideNDC(p.p.clipPosition)) {
+    if (computeOutcode(p.p.clipPosition) == 0) {
       clipped.push_back(p);
     }
   }
@@ -181,6 +175,15 @@ Clipper::clipTriangles(render::TrianglePrimitiveList triangles) const {
       float db = plane.distance(triangle.b.clipPosition);
       float dc = plane.distance(triangle.c.clipPosition);
 
+      // Nothing but an edge or a corner on the plane is left, discard.
+      if (da <= 0 && db <= 0 && dc <= 0) {
+        keep = false;
+        break;
+      }
+
+      // In the cases with two points inside, one of them may be on the plane.
+      // Its edge towards the outside point is then cut at the point itself,
+      // and only one of the two triangles has an area.
       // a inside; b,c outside;
       if (da >= 0 && db < 0 && dc < 0) {
         triangle.b = clipEdge(triangle.a, triangle.b, plane);
@@ -205,6 +208,11 @@ Clipper::clipTriangles(render::TrianglePrimitiveList triangles) const {
       if (da >= 0 && db >= 0) {
         VertexOut p = clipEdge(triangle.a, triangle.c, plane);
         VertexOut q = clipEdge(triangle.b, triangle.c, plane);
+        if (da == 0 || db == 0) {
+          triangle.c = da == 0 ? q : p;
+          continue;
+        }
+
         // Truncate current triangle, add new one to the list.
         triangle.c = p;
 
@@ -219,6 +227,11 @@ Clipper::clipTriangles(render::TrianglePrimitiveList triangles) const {
       if (da >= 0 && dc >= 0) {
         VertexOut p = clipEdge(triangle.a, triangle.b, plane);
         VertexOut q = clipEdge(triangle.c, triangle.b, plane);
+        if (da == 0 || dc == 0) {
+          triangle.b = da == 0 ? q : p;
+          continue;
+        }
+
         triangle.b = p;
 
         TrianglePrimitive t(p, q, triangle.c);
@@ -232,6 +245,11 @@ Clipper::clipTriangles(render::TrianglePrimitiveList triangles) const {
       if (db >= 0 && dc >= 0) {
         VertexOut p = clipEdge(triangle.b, triangle.a, plane);
         VertexOut q = clipEdge(triangle.c, triangle.a, plane);
+        if (db == 0 || dc == 0) {
+          triangle.a = db == 0 ? q : p;
+          continue;
+        }
+
         triangle.a = p;
 
         TrianglePrimitive t(p, triangle.c, q);
@@ -250,83 +268,173 @@ Clipper::clipTriangles(render::TrianglePrimitiveList triangles) const {
   return clipped;
 }
 
-// Selects the endpoint for a given triangle edge.
-static const VertexOut &getTriangleEdgePoint(const TrianglePrimitive &triangle,
-                                             int i) {
-  switch (i) {
-  case 0:
-    return triangle.a;
-  case 1:
-    return triangle.b;
-  case 2:
-    return triangle.c;
-  case 3:
-    // This allows connecting the last edge to the beginning.
-    return triangle.a;
+unsigned int Clipper::computeOutcode(const glm::vec4 &p,
+                                     const glm::vec2 &guardBand) {
+  const float gx = guardBand.x * p.w;
+  const float gy = guardBand.y * p.w;
+
+  unsigned int code = 0;
+  if (p.x < -gx)
+    code |= OUTSIDE_LEFT;
+  if (p.x > gx)
+    code |= OUTSIDE_RIGHT;
+  if (p.y < -gy)
+    code |= OUTSIDE_BOTTOM;
+  if (p.y > gy)
+    code |= OUTSIDE_TOP;
+  if (p.z < -p.w || p.w <= 0)
+    code |= OUTSIDE_NEAR;
+  if (p.z > p.w)
+    code |= OUTSIDE_FAR;
+  return code;
+}
 
+// Signed distance of a clip-space position to one side of the view volume,
+// given by its outcode bit. Positive is inside.
+static inline float distanceToSide(const glm::vec4 &p, unsigned int side) {
+  switch (side) {
+  case Clipper::OUTSIDE_LEFT:
+    return p.w + p.x;
+  case Clipper::OUTSIDE_RIGHT:
+    return p.w - p.x;
+  case Clipper::OUTSIDE_BOTTOM:
+    return p.w + p.y;
+  case Clipper::OUTSIDE_TOP:
+    return p.w - p.y;
+  case Clipper::OUTSIDE_NEAR:
+    return p.w + p.z;
   default:
-    // This is bad.
-    std::cerr << "Bad triangle edge selection." << std::endl;
-    return VertexOut();
+    return p.w - p.z;
   }
 }
 
-// Sutherland-Hodgeman triangle clipping.
-// Based on:
+// A convex polygon with room for a triangle clipped against all six sides.
+struct ClipPolygon {
+  VertexOut vertices[Clipper::MAX_CLIPPED_VERTICES];
+  int count = 0;
+};
+
+// Appends a vertex to a polygon. Exact clipping of a triangle never needs more
+// room than there is; should rounding ever produce more vertices, this fails
+// in debug builds and drops the vertex otherwise, rather than writing past
+// the end.
+static inline void addVertex(ClipPolygon &polygon, const VertexOut &v) {
+  assert(polygon.count < Clipper::MAX_CLIPPED_VERTICES);
+  if (polygon.count < Clipper::MAX_CLIPPED_VERTICES)
+    polygon.vertices[polygon.count++] = v;
+}
+
+// One Sutherland-Hodgman step: clips the polygon in against a side of the view
+// volume and writes the result to out. Intersections are always calculated
+// from the inside towards the outside vertex, so that neighboring triangles
+// get the exact same points on their shared edges.
 // https://www.flipcode.com/archives/Real-time_3D_Clipping_Sutherland-Hodgeman.shtml
-static TrianglePrimitiveList clipTriangle(const TrianglePrimitive &triangle,
-                                          const Clipper::Plane &plane) {
-  // Contains clipped coordinates.
-  std::vector<VertexOut> clipped;
-  for (int i = 0; i < 3; ++i) {
-    const VertexOut &v1 = getTriangleEdgePoint(triangle, i);
-    const VertexOut &v2 = getTriangleEdgePoint(triangle, i + 1);
-
-    float d1 = plane.distance(v1.clipPosition);
-    float d2 = plane.distance(v2.clipPosition);
-
-    // v1 inside, v2 outside
-    if (d1 >= 0 && d2 < 0)
-      clipped.push_back(clipEdge(v1, v2, plane));
-
-    // v1 outside, v1 inside
-    if (d1 < 0 && d2 >= 0) {
-      clipped.push_back(clipEdge(v1, v2, plane));
-      clipped.push_back(v2);
+static void clipPolygon(const ClipPolygon &in, unsigned int side,
+                        ClipPolygon &out) {
+  out.count = 0;
+  if (in.count == 0)
+    return;
+
+  const VertexOut *v1 = &in.vertices[in.count - 1];
+  float d1 = distanceToSide(v1->clipPosition, side);
+
+  for (int i = 0; i < in.count; ++i) {
+    const VertexOut *v2 = &in.vertices[i];
+    const float d2 = distanceToSide(v2->clipPosition, side);
+
+    // Vertices on the plane are kept as they are, no need to intersect.
+    if (d1 > 0 && d2 < 0) {
+      addVertex(out, lerp(*v1, *v2, d1 / (d1 - d2)));
+    } else if (d1 < 0 && d2 > 0) {
+      addVertex(out, lerp(*v2, *v1, d2 / (d2 - d1)));
     }
 
-    // v1 and v2 inside
-    if (d1 >= 0 && d2 >= 0)
-      clipped.push_back(v2);
+    if (d2 >= 0)
+      addVertex(out, *v2);
 
-    // v1 and v2 outside -- don't do anything
+    v1 = v2;
+    d1 = d2;
   }
+}
+
+unsigned int Clipper::clipTriangleToNdc(const VertexOut &a, const VertexOut &b,
+                                        const VertexOut &c,
+                                        unsigned int planeMask,
+                                        const glm::vec2 &guardBand,
+                                        VertexOutList &out) {
+  // Near and far first, so that the guard band check afterwards only sees
+  // vertices in front of the viewer.
+  static const unsigned int sides[] = {OUTSIDE_NEAR,   OUTSIDE_FAR,
+                                       OUTSIDE_LEFT,   OUTSIDE_RIGHT,
+                                       OUTSIDE_BOTTOM, OUTSIDE_TOP};
+
+  ClipPolygon polygons[2];
+  ClipPolygon *current = &polygons[0];
+  ClipPolygon *next = &polygons[1];
+  current->vertices[0] = a;
+  current->vertices[1] = b;
+  current->vertices[2] = c;
+  current->count = 3;
+
+  for (unsigned int side : sides) {
+    if (!(planeMask & side))
+      continue;
+
+    // With a guard band, the sides only need clipping if the polygon reaches
+    // beyond it.
+    if (side & (OUTSIDE_LEFT | OUTSIDE_RIGHT | OUTSIDE_BOTTOM | OUTSIDE_TOP)) {
+      bool outside = false;
+      for (int i = 0; i < current->count && !outside; ++i) {
+        outside =
+            (computeOutcode(current->vertices[i].clipPosition, guardBand) &
+             side) != 0;
+      }
+      if (!outside)
+        continue;
+    }
 
-  // Reconstruct the triangle(s) from the clipped edges. The output can be
-  // either zero, one or two triangles.
-  TrianglePrimitiveList output;
-  if (clipped.size() >= 3) {
-    output.push_back(TrianglePrimitive(clipped[0], clipped[1], clipped[2]));
+    clipPolygon(*current, side, *next);
+    std::swap(current, next);
   }
-  if (clipped.size() == 4) {
-    auto t = TrianglePrimitive(clipped[2], clipped[3], clipped[0]);
-    setColor(t, glm::vec4(1, 1, 0, 1));
-    output.push_back(t);
+
+  // Triangulate the polygon as a fan; this keeps the winding order.
+  unsigned int triangles = 0;
+  for (int i = 1; i + 1 < current->count; ++i) {
+    out.push_back(current->vertices[0]);
+    out.push_back(current->vertices[i]);
+    out.push_back(current->vertices[i + 1]);
+    ++triangles;
   }
-  return output;
+  return triangles;
 }
 
 TrianglePrimitiveList Clipper::clipTrianglesToNdc(
     const TrianglePrimitiveList &clipspaceTriangles) const {
-  TrianglePrimitiveList clipped = clipspaceTriangles;
-  for (const auto &plane : planes) {
-    TrianglePrimitiveList temp;
+  TrianglePrimitiveList clipped;
+  clipped.reserve(clipspaceTriangles.size());
+
+  VertexOutList vertices;
+  for (const TrianglePrimitive &t : clipspaceTriangles) {
+    const unsigned int ca = computeOutcode(t.a.clipPosition);
+    const unsigned int cb = computeOutcode(t.b.clipPosition);
+    const unsigned int cc = computeOutcode(t.c.clipPosition);
+
+    // Trivial reject -- all corners outside of the same side.
+    if (ca & cb & cc)
+      continue;
+
+    // Trivial accept -- all corners inside.
+    if (!(ca | cb | cc)) {
+      clipped.push_back(t);
+      continue;
+    }
 
-    for (const auto &t : clipped) {
-      auto result = clipTriangle(t, plane);
-      temp.insert(temp.end(), result.begin(), result.end());
+    vertices.clear();
+    clipTriangleToNdc(t.a, t.b, t.c, ca | cb | cc, glm::vec2(1.f), vertices);
+    for (size_t i = 0; i < vertices.size(); i += 3) {
+      clipped.push_back(
+          TrianglePrimitive(vertices[i], vertices[i + 1], vertices[i + 2]));
     }
-    clipped = temp;
   }
   return clipped;
 }
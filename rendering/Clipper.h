@@ -35,6 +35,23 @@ public:
     inline glm::vec3 getNormal() const { return glm::vec3(plane); }
   };
 
+  // Outcode bits, one for each side of the view volume. A bit is set if a
+  // position is on the outside of that side.
+  enum Outcode : unsigned int {
+    OUTSIDE_LEFT = 1,
+    OUTSIDE_RIGHT = 2,
+    OUTSIDE_BOTTOM = 4,
+    OUTSIDE_TOP = 8,
+    OUTSIDE_NEAR = 16,
+    OUTSIDE_FAR = 32,
+
+    OUTSIDE_ANY = 63
+  };
+
+  // The most vertices a triangle can have after clipping against all six
+  // sides of the view volume.
+  static const int MAX_CLIPPED_VERTICES = 9;
+
   explicit Clipper(const Plane &plane);
 
   explicit Clipper(const std::vector<Plane> &planes);
@@ -49,9 +66,30 @@ public:
 
   TrianglePrimitiveList clipTriangles(TrianglePrimitiveList triangles) const;
 
+  // Clips triangles given in clip space to the view volume, see
+  // clipTriangleToNdc. This ignores the planes of the clipper.
   TrianglePrimitiveList
   clipTrianglesToNdc(const TrianglePrimitiveList &triangles) const;
 
+  // Computes the outcode of a clip-space position. The left, right, bottom and
+  // top sides are moved out to +-guardBand * w; a guard band of 1 is the view
+  // volume itself. Positions with w <= 0 are always outside the near side.
+  static unsigned int
+  computeOutcode(const glm::vec4 &clipPosition,
+                 const glm::vec2 &guardBand = glm::vec2(1.f));
+
+  // Clips a triangle in clip space against the sides of the view volume whose
+  // bits are set in planeMask and appends the result to out as a fan of
+  // triangles, three vertices each. Returns the number of triangles appended.
+  // The near and far side are clipped first; after that, the other sides are
+  // skipped if all vertices are within the guard band. Clipping happens on
+  // the stack, so out is the only memory that may grow; reuse it between calls.
+  static unsigned int clipTriangleToNdc(const VertexOut &a, const VertexOut &b,
+                                        const VertexOut &c,
+                                        unsigned int planeMask,
+                                        const glm::vec2 &guardBand,
+                                        VertexOutList &out);
+
 private:
   std::vector<Plane> planes;
 };
@@ -435,6 +435,17 @@ int testClipperTriangleSinglePlaneTwoPointsInside() {
   assert(clipped[1].b.clipPosition == vec4(-2, -1, 0, 1));
   assert(clipped[1].c.clipPosition == vec4(-1, 0, 0, 1));
 
+  // With one of the two inside on the plane, there is only one triangle.
+  TrianglePrimitiveList touching;
+  touching.push_back(
+      makeTriangle(vec3(-2, 0, 0), vec3(4, 2, 0), vec3(0, -2, 0)));
+  clipped = clipper.clipTriangles(touching);
+
+  assert(clipped.size() == 1);
+  assert(clipped[0].a.clipPosition == vec4(-2, 0, 0, 1));
+  assert(clipped[0].b.clipPosition == vec4(2, 0, 0, 1));
+  assert(clipped[0].c.clipPosition == vec4(0, -2, 0, 1));
+
   return 0;
 }
 
@@ -462,6 +473,65 @@ int testClipperTriangleMultiplePlanes() {
   return 0;
 }
 
+int testClipperOutcodes() {
+  assert(Clipper::computeOutcode(vec4(0, 0, 0, 1)) == 0);
+  assert(Clipper::computeOutcode(vec4(1, -1, 1, 1)) == 0);
+  assert(Clipper::computeOutcode(vec4(2, 0, 0, 1)) == Clipper::OUTSIDE_RIGHT);
+  assert(Clipper::computeOutcode(vec4(-2, 3, 0, 1)) ==
+         (Clipper::OUTSIDE_LEFT | Clipper::OUTSIDE_TOP));
+  assert(Clipper::computeOutcode(vec4(0, 0, 2, 1)) == Clipper::OUTSIDE_FAR);
+
+  // Behind the viewer is always outside.
+  assert(Clipper::computeOutcode(vec4(0, 0, 0, -1)) & Clipper::OUTSIDE_NEAR);
+
+  // A guard band only moves the sides.
+  assert(Clipper::computeOutcode(vec4(2, -2, 0, 1), vec2(3)) == 0);
+  assert(Clipper::computeOutcode(vec4(2, 0, 2, 1), vec2(3)) ==
+         Clipper::OUTSIDE_FAR);
+  return 0;
+}
+
+int testClipperTriangleToNdc() {
+  const TrianglePrimitive t =
+      makeTriangle(vec3(0, 0, 0), vec3(2, 0, 0), vec3(0, 2, 0));
+  const unsigned int mask = Clipper::computeOutcode(t.a.clipPosition) |
+                            Clipper::computeOutcode(t.b.clipPosition) |
+                            Clipper::computeOutcode(t.c.clipPosition);
+  assert(mask == (Clipper::OUTSIDE_RIGHT | Clipper::OUTSIDE_TOP));
+
+  // Cut down to the unit square in the lower left corner, i.e. two triangles.
+  VertexOutList out;
+  assert(Clipper::clipTriangleToNdc(t.a, t.b, t.c, mask, vec2(1), out) == 2);
+  assert(out.size() == 6);
+  int corners = 0;
+  for (const VertexOut &v : out) {
+    assert(Clipper::computeOutcode(v.clipPosition) == 0);
+    assert(v.clipPosition.x == 0 || v.clipPosition.x == 1);
+    assert(v.clipPosition.y == 0 || v.clipPosition.y == 1);
+
+    // Attributes are interpolated along with the position.
+    if (v.clipPosition == vec4(1, 0, 0, 1)) {
+      assert(v.texcoord == vec2(0.5f, 0));
+      ++corners;
+    }
+  }
+  assert(corners > 0);
+
+  // Inside of the guard band nothing happens; the output is appended.
+  assert(Clipper::clipTriangleToNdc(t.a, t.b, t.c, mask, vec2(4), out) == 1);
+  assert(out.size() == 9);
+  assert(out[6].clipPosition == t.a.clipPosition);
+  assert(out[7].clipPosition == t.b.clipPosition);
+  assert(out[8].clipPosition == t.c.clipPosition);
+
+  // Nothing is left of triangles behind the viewer.
+  const TrianglePrimitive behind =
+      makeTriangle(vec3(0, 0, -2), vec3(1, 0, -2), vec3(0, 1, -2));
+  assert(Clipper::clipTriangleToNdc(behind.a, behind.b, behind.c,
+                                    Clipper::OUTSIDE_ANY, vec2(1), out) == 0);
+  return 0;
+}
+
 int main(int argc, const char **argv) {
   const std::string test(argv[1]);
 
@@ -548,5 +618,13 @@ int main(int argc, const char **argv) {
     return testClipperTriangleMultiplePlanes();
   }
 
+  if (test == "clipper-outcodes") {
+    return testClipperOutcodes();
+  }
+
+  if (test == "clipper-triangle-to-ndc") {
+    return testClipperTriangleToNdc();
+  }
+
   return 0;
 }
@@ -1,22 +1,206 @@
 #include "Depthbuffer.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cfloat>
+#include <cstring>
 
 namespace render {
 
-Depthbuffer::Depthbuffer(unsigned int w, unsigned int h) : width(w), height(h) {
-  data = new float[width * height];
+static size_t getDepthSize(DepthFormat format) {
+  switch (format) {
+  case DepthFormat::UNORM16:
+    return sizeof(DepthFormatTraits<DepthFormat::UNORM16>::Type);
+  case DepthFormat::UNORM24:
+    return sizeof(DepthFormatTraits<DepthFormat::UNORM24>::Type);
+  default:
+    return sizeof(DepthFormatTraits<DepthFormat::FLOAT32>::Type);
+  }
+}
+
+Depthbuffer::Depthbuffer(unsigned int w, unsigned int h, DepthFormat format,
+                         BufferLayout layout)
+    : width(w), height(h), format(format), layout(layout),
+      tilesX((w + TILE_SIZE - 1) / TILE_SIZE),
+      tilesY((h + TILE_SIZE - 1) / TILE_SIZE) {
+  data = new unsigned char[getBufferSize(layout, width, height, tilesX,
+                                         tilesY) *
+                           getDepthSize(format)];
+  tileMin = new float[tilesX * tilesY];
+  tileMax = new float[tilesX * tilesY];
+  clearPending = new unsigned char[tilesX * tilesY];
+  clear();
 }
 
-Depthbuffer::~Depthbuffer() { delete[] data; }
+Depthbuffer::~Depthbuffer() {
+  delete[] static_cast<unsigned char *>(data);
+  delete[] tileMin;
+  delete[] tileMax;
+  delete[] clearPending;
+}
 
 void Depthbuffer::clear() {
-  for (unsigned int i = 0; i < width * height; ++i) {
-    data[i] = FLT_MAX;
+  switch (format) {
+  case DepthFormat::UNORM16:
+    clear<DepthFormat::UNORM16>();
+    break;
+  case DepthFormat::UNORM24:
+    clear<DepthFormat::UNORM24>();
+    break;
+  default:
+    clear<DepthFormat::FLOAT32>();
+    break;
+  }
+}
+
+template <DepthFormat F> void Depthbuffer::clear() {
+  typedef DepthFormatTraits<F> Traits;
+
+  // The pixels are filled on first write, see resolveClear().
+  memset(clearPending, 1, tilesX * tilesY);
+
+  const float depth = Traits::decode(Traits::CLEAR);
+  std::fill(tileMin, tileMin + tilesX * tilesY, depth);
+  std::fill(tileMax, tileMax + tilesX * tilesY, depth);
+}
+
+void Depthbuffer::resolveClears() {
+  switch (format) {
+  case DepthFormat::UNORM16:
+    resolveClears<DepthFormat::UNORM16>();
+    break;
+  case DepthFormat::UNORM24:
+    resolveClears<DepthFormat::UNORM24>();
+    break;
+  default:
+    resolveClears<DepthFormat::FLOAT32>();
+    break;
+  }
+}
+
+template <DepthFormat F> void Depthbuffer::resolveClears() {
+  const unsigned int tiles = tilesX * tilesY;
+  const unsigned int pending =
+      std::count(clearPending, clearPending + tiles, 1);
+  if (pending == tiles) {
+    std::fill(getData<F>(),
+              getData<F>() +
+                  getBufferSize(layout, width, height, tilesX, tilesY),
+              DepthFormatTraits<F>::CLEAR);
+    memset(clearPending, 0, tiles);
+  } else if (pending) {
+    for (unsigned int tile = 0; tile < tiles; ++tile) {
+      if (clearPending[tile])
+        resolveClear<F>(tile);
+    }
+  }
+}
+
+template <DepthFormat F> void Depthbuffer::resolveClear(unsigned int tile) {
+  const unsigned int x0 = tile % tilesX * TILE_SIZE;
+  const unsigned int y0 = tile / tilesX * TILE_SIZE;
+  const unsigned int x1 = std::min(x0 + TILE_SIZE, width);
+  const unsigned int y1 = std::min(y0 + TILE_SIZE, height);
+
+  for (unsigned int y = y0; y < y1; ++y) {
+    typename DepthFormatTraits<F>::Type *row =
+        getData<F>() + getPixelIndex(x0, y);
+    std::fill(row, row + (x1 - x0), DepthFormatTraits<F>::CLEAR);
+  }
+  clearPending[tile] = 0;
+}
+
+void Depthbuffer::updateTile(int x, int y) {
+  switch (format) {
+  case DepthFormat::UNORM16:
+    updateTile<DepthFormat::UNORM16>(x, y);
+    break;
+  case DepthFormat::UNORM24:
+    updateTile<DepthFormat::UNORM24>(x, y);
+    break;
+  default:
+    updateTile<DepthFormat::FLOAT32>(x, y);
+    break;
   }
 }
 
+template <DepthFormat F> void Depthbuffer::updateTile(int x, int y) {
+  typedef typename DepthFormatTraits<F>::Type Type;
+
+  // Nothing was written since the tile was cleared; the bounds are exact.
+  if (clearPending[getTileIndex(x, y)])
+    return;
+
+  const unsigned int x0 = x - x % TILE_SIZE;
+  const unsigned int y0 = y - y % TILE_SIZE;
+  const unsigned int x1 = std::min(x0 + TILE_SIZE, width);
+  const unsigned int y1 = std::min(y0 + TILE_SIZE, height);
+
+  // Compare the stored values and only convert the result.
+  const Type *pixels = getData<F>();
+  Type nearest = pixels[getPixelIndex(x0, y0)], farthest = nearest;
+  for (unsigned int ty = y0; ty < y1; ++ty) {
+    for (unsigned int tx = x0; tx < x1; ++tx) {
+      nearest = std::min(nearest, pixels[getPixelIndex(tx, ty)]);
+      farthest = std::max(farthest, pixels[getPixelIndex(tx, ty)]);
+    }
+  }
+
+  const unsigned int tile = getTileIndex(x, y);
+  tileMin[tile] = DepthFormatTraits<F>::decode(nearest);
+  tileMax[tile] = DepthFormatTraits<F>::decode(farthest);
+}
+
+bool Depthbuffer::isAnyVisible(const glm::ivec2 &min, const glm::ivec2 &max,
+                               float z) const {
+  for (int y = min.y / TILE_SIZE; y <= max.y / TILE_SIZE; ++y) {
+    for (int x = min.x / TILE_SIZE; x <= max.x / TILE_SIZE; ++x) {
+      if (z < tileMax[x + tilesX * y])
+        return true;
+    }
+  }
+  return false;
+}
+
+unsigned int Depthbuffer::getVisibleMask(int x, int y, const float *z,
+                                         int count) const {
+  assert(count <= 32);
+  switch (format) {
+  case DepthFormat::UNORM16:
+    return getVisibleMask<DepthFormat::UNORM16>(x, y, z, count);
+  case DepthFormat::UNORM24:
+    return getVisibleMask<DepthFormat::UNORM24>(x, y, z, count);
+  default:
+    return getVisibleMask<DepthFormat::FLOAT32>(x, y, z, count);
+  }
+}
+
+template <DepthFormat F>
+unsigned int Depthbuffer::getVisibleMask(int x, int y, const float *z,
+                                         int count) const {
+  typedef DepthFormatTraits<F> Traits;
+
+  // Tile by tile, as tiles may still be waiting to be cleared. The loops are
+  // branch-free, so that the compiler can vectorize them.
+  unsigned int mask = 0;
+  for (int j = 0; j < count;) {
+    const int end = std::min(count, j + TILE_SIZE - (x + j) % TILE_SIZE);
+    if (clearPending[getTileIndex(x + j, y)]) {
+      for (; j < end; ++j) {
+        mask |= (unsigned int)(Traits::encode(z[j]) < Traits::CLEAR) << j;
+      }
+    } else {
+      // Within a tile, a row of pixels is contiguous in every layout.
+      const typename Traits::Type *pixels =
+          getData<F>() + getPixelIndex(x + j, y) - j;
+      for (; j < end; ++j) {
+        mask |= (unsigned int)(Traits::encode(z[j]) < pixels[j]) << j;
+      }
+    }
+  }
+  return mask;
+}
+
 bool Depthbuffer::conditionalPlot(const glm::vec3 &pos) {
   auto x = (int)pos.x;
   auto y = (int)pos.y;
@@ -32,12 +216,23 @@ bool Depthbuffer::conditionalPlot(int x, int y, float z) {
     return false;
   }
 
-  unsigned int i = x + width * y;
-  if (data[i] > z) {
-    data[i] = z;
+  switch (format) {
+  case DepthFormat::UNORM16:
+    return conditionalPlot<DepthFormat::UNORM16>(x, y, z);
+  case DepthFormat::UNORM24:
+    return conditionalPlot<DepthFormat::UNORM24>(x, y, z);
+  default:
+    return conditionalPlot<DepthFormat::FLOAT32>(x, y, z);
+  }
+}
+
+template <DepthFormat F>
+bool Depthbuffer::conditionalPlot(unsigned int x, unsigned int y, float z) {
+  if (isVisible<F>(x, y, z)) {
+    plot<F>(x, y, z);
     return true;
   } else
     return false;
 }
 
-}
\ No newline at end of file
+}
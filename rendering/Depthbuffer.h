@@ -1,23 +1,102 @@
 #ifndef DEPTHBUFFER_INCLUDED
 #define DEPTHBUFFER_INCLUDED
 
+#include <cfloat>
+#include <cstdint>
+
 #include <glm/glm.hpp>
 
+#include "BufferLayout.h"
+
 namespace render {
 
+// Storage format of the depth values.
+enum class DepthFormat {
+  // 32 bit float; cleared to FLT_MAX.
+  FLOAT32,
+  // Window-space depth in [0, 1] as 16 bit unsigned normalized integer;
+  // cleared to 1.
+  UNORM16,
+  // Same with 24 bits of precision, stored in the low bits of a 32 bit word.
+  UNORM24
+};
+
+// Per format storage type and conversion from and to window-space depth. Depth
+// is truncated when it is converted to fixed point, so that comparing the
+// stored values gives the same result as comparing the float depth to the
+// converted-back value.
+template <DepthFormat F> struct DepthFormatTraits;
+
+template <> struct DepthFormatTraits<DepthFormat::FLOAT32> {
+  typedef float Type;
+  static constexpr Type CLEAR = FLT_MAX;
+
+  static inline Type encode(float z) { return z; }
+  static inline float decode(Type z) { return z; }
+};
+
+template <> struct DepthFormatTraits<DepthFormat::UNORM16> {
+  typedef uint16_t Type;
+  static constexpr Type CLEAR = 0xffff;
+
+  static inline Type encode(float z) {
+    return (Type)(glm::clamp(z, 0.f, 1.f) * CLEAR);
+  }
+  static inline float decode(Type z) { return z * (1.f / CLEAR); }
+};
+
+template <> struct DepthFormatTraits<DepthFormat::UNORM24> {
+  typedef uint32_t Type;
+  static constexpr Type CLEAR = 0xffffff;
+
+  // Single precision has no bits to spare for 24 bit depth.
+  static inline Type encode(float z) {
+    return (Type)((double)glm::clamp(z, 0.f, 1.f) * CLEAR);
+  }
+  static inline float decode(Type z) { return (float)(z * (1.0 / CLEAR)); }
+};
+
+// A depth buffer. Besides the depth of every pixel, it keeps the nearest and
+// farthest depth of every TILE_SIZE x TILE_SIZE tile, so that whole blocks of
+// pixels can be tested at once. These tile bounds are conservative: every
+// write widens them, and updateTile() shrinks them back to the actual range.
+//
+// Depth is passed in and out as float, whatever the storage format; the depth
+// test converts the incoming depth and compares the stored values.
+//
+// Clearing is lazy: clear() only flags the tiles, and the pixels of a tile are
+// set to the clear value when it is first written to. Reads of a flagged tile
+// return the clear value. Tiles that are never drawn to are never filled.
 class Depthbuffer {
 public:
-  Depthbuffer(unsigned int w, unsigned int h);
+  static const int TILE_SIZE = BUFFER_TILE_SIZE;
+
+  Depthbuffer(unsigned int w, unsigned int h,
+              DepthFormat format = DepthFormat::FLOAT32,
+              BufferLayout layout = BufferLayout::LINEAR);
 
   virtual ~Depthbuffer();
 
   virtual void clear();
 
+  // Fills the pixels of all tiles that are still flagged by clear(). If all
+  // of them are, the whole buffer is filled at once.
+  void resolveClears();
+
   inline unsigned int getWidth() const { return width; }
   inline unsigned int getHeight() const { return height; }
+  inline DepthFormat getFormat() const { return format; }
+  inline BufferLayout getLayout() const { return layout; }
 
   inline float getDepth(unsigned int x, unsigned int y) const {
-    return data[x + width * y];
+    switch (format) {
+    case DepthFormat::UNORM16:
+      return getDepth<DepthFormat::UNORM16>(x, y);
+    case DepthFormat::UNORM24:
+      return getDepth<DepthFormat::UNORM24>(x, y);
+    default:
+      return getDepth<DepthFormat::FLOAT32>(x, y);
+    }
   }
 
   inline void plot(const glm::ivec2& coords, float depth) {
@@ -25,7 +104,17 @@ public:
   }
 
   inline void plot(unsigned int x, unsigned int y, float z) {
-    data[x + width * y] = z;
+    switch (format) {
+    case DepthFormat::UNORM16:
+      plot<DepthFormat::UNORM16>(x, y, z);
+      break;
+    case DepthFormat::UNORM24:
+      plot<DepthFormat::UNORM24>(x, y, z);
+      break;
+    default:
+      plot<DepthFormat::FLOAT32>(x, y, z);
+      break;
+    }
   }
 
   bool conditionalPlot(const glm::vec3 &pos);
@@ -37,14 +126,135 @@ public:
   }
 
   inline bool isVisible(int x, int y, float z) const {
-    return z < data[x + width * y];
+    switch (format) {
+    case DepthFormat::UNORM16:
+      return isVisible<DepthFormat::UNORM16>(x, y, z);
+    case DepthFormat::UNORM24:
+      return isVisible<DepthFormat::UNORM24>(x, y, z);
+    default:
+      return isVisible<DepthFormat::FLOAT32>(x, y, z);
+    }
+  }
+
+  // Whether z is exactly the stored depth; the test of the second step of a
+  // depth pre-pass.
+  inline bool isEqual(int x, int y, float z) const {
+    switch (format) {
+    case DepthFormat::UNORM16:
+      return isEqual<DepthFormat::UNORM16>(x, y, z);
+    case DepthFormat::UNORM24:
+      return isEqual<DepthFormat::UNORM24>(x, y, z);
+    default:
+      return isEqual<DepthFormat::FLOAT32>(x, y, z);
+    }
+  }
+
+  // Depth test of count <= 32 pixels in a row, starting at x, y: bit i of the
+  // result is set if z[i] is visible at x + i, y.
+  unsigned int getVisibleMask(int x, int y, const float *z, int count) const;
+
+  // Bounds of the depth values in the tile that contains pixel x, y.
+  inline float getTileMin(int x, int y) const {
+    return tileMin[getTileIndex(x, y)];
+  }
+
+  inline float getTileMax(int x, int y) const {
+    return tileMax[getTileIndex(x, y)];
   }
 
+  // Recalculates the bounds of the tile that contains pixel x, y from its
+  // pixels.
+  void updateTile(int x, int y);
+
+  // Returns false if depth z is hidden everywhere in the inclusive rectangle
+  // [min, max], judging by the tile bounds alone. Returns true if it may be
+  // visible somewhere.
+  bool isAnyVisible(const glm::ivec2 &min, const glm::ivec2 &max,
+                    float z) const;
+
 protected:
   unsigned int width, height;
-  float *data;
+  DepthFormat format;
+  BufferLayout layout;
+  void *data;
+
+  // Per tile bounds, row by row. These hold the stored depth values converted
+  // back to float.
+  unsigned int tilesX, tilesY;
+  float *tileMin;
+  float *tileMax;
+
+  // Set for the tiles whose pixels still have to be cleared. One byte per
+  // tile, so that threads working on different tiles never share one.
+  unsigned char *clearPending;
+
+  inline unsigned int getTileIndex(int x, int y) const {
+    return x / TILE_SIZE + tilesX * (y / TILE_SIZE);
+  }
+
+  inline unsigned int getPixelIndex(unsigned int x, unsigned int y) const {
+    return getBufferIndex(layout, x, y, width, tilesX);
+  }
+
+  // The implementations for the storage formats.
+  template <DepthFormat F>
+  inline typename DepthFormatTraits<F>::Type *getData() const {
+    return static_cast<typename DepthFormatTraits<F>::Type *>(data);
+  }
+
+  // The stored value of pixel x, y, taking pending clears into account.
+  template <DepthFormat F>
+  inline typename DepthFormatTraits<F>::Type getStored(unsigned int x,
+                                                       unsigned int y) const {
+    return clearPending[getTileIndex(x, y)] ? DepthFormatTraits<F>::CLEAR
+                                            : getData<F>()[getPixelIndex(x, y)];
+  }
+
+  template <DepthFormat F>
+  inline float getDepth(unsigned int x, unsigned int y) const {
+    return DepthFormatTraits<F>::decode(getStored<F>(x, y));
+  }
+
+  template <DepthFormat F>
+  inline void plot(unsigned int x, unsigned int y, float z) {
+    const unsigned int tile = getTileIndex(x, y);
+    if (clearPending[tile])
+      resolveClear<F>(tile);
+
+    const auto stored = DepthFormatTraits<F>::encode(z);
+    getData<F>()[getPixelIndex(x, y)] = stored;
+
+    const float depth = DepthFormatTraits<F>::decode(stored);
+    tileMin[tile] = glm::min(tileMin[tile], depth);
+    tileMax[tile] = glm::max(tileMax[tile], depth);
+  }
+
+  template <DepthFormat F>
+  inline bool isVisible(unsigned int x, unsigned int y, float z) const {
+    return DepthFormatTraits<F>::encode(z) < getStored<F>(x, y);
+  }
+
+  template <DepthFormat F>
+  inline bool isEqual(unsigned int x, unsigned int y, float z) const {
+    return DepthFormatTraits<F>::encode(z) == getStored<F>(x, y);
+  }
+
+  // Fills the pixels of a tile flagged by clear() and removes the flag.
+  template <DepthFormat F> void resolveClear(unsigned int tile);
+
+  template <DepthFormat F> void resolveClears();
+
+  template <DepthFormat F>
+  bool conditionalPlot(unsigned int x, unsigned int y, float z);
+
+  template <DepthFormat F> void clear();
+
+  template <DepthFormat F> void updateTile(int x, int y);
+
+  template <DepthFormat F>
+  unsigned int getVisibleMask(int x, int y, const float *z, int count) const;
 };
 
 } // namespace render
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,84 @@
+#include "FrameSink.h"
+
+#include <algorithm>
+
+#include "Image.h"
+
+namespace render {
+
+FrameSink::FrameSink(unsigned int width, unsigned int height,
+                     PixelFormat format, unsigned int bufferCount)
+    : writing(false), writeErrors(0), shutdown(false) {
+  for (unsigned int i = 0; i < std::max(bufferCount, 1u); ++i) {
+    buffers.push_back(std::make_shared<Framebuffer>(width, height, format));
+    freeBuffers.push_back(buffers.back());
+  }
+
+  writer = std::thread(&FrameSink::writerLoop, this);
+}
+
+FrameSink::~FrameSink() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    shutdown = true;
+  }
+  frameQueued.notify_one();
+  writer.join();
+}
+
+std::shared_ptr<Framebuffer> FrameSink::acquire() {
+  std::unique_lock<std::mutex> lock(mutex);
+  bufferFreed.wait(lock, [this]() { return !freeBuffers.empty(); });
+
+  std::shared_ptr<Framebuffer> framebuffer = freeBuffers.front();
+  freeBuffers.pop_front();
+  return framebuffer;
+}
+
+void FrameSink::submit(const std::shared_ptr<Framebuffer> &framebuffer,
+                       const std::string &filename) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    queue.push_back(Frame{framebuffer, filename});
+  }
+  frameQueued.notify_one();
+}
+
+void FrameSink::flush() {
+  std::unique_lock<std::mutex> lock(mutex);
+  bufferFreed.wait(lock, [this]() { return queue.empty() && !writing; });
+}
+
+unsigned int FrameSink::getWriteErrors() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return writeErrors;
+}
+
+void FrameSink::writerLoop() {
+  for (;;) {
+    Frame frame;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      frameQueued.wait(lock, [this]() { return shutdown || !queue.empty(); });
+      // Drain the queue before shutting down.
+      if (queue.empty())
+        return;
+      frame = std::move(queue.front());
+      queue.pop_front();
+      writing = true;
+    }
+
+    const bool written = writePPM(frame.filename, *frame.framebuffer);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!written)
+        ++writeErrors;
+      freeBuffers.push_back(frame.framebuffer);
+      writing = false;
+    }
+    bufferFreed.notify_all();
+  }
+}
+
+} // namespace render
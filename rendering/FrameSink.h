@@ -0,0 +1,80 @@
+#ifndef GFX1993_FRAMESINK_H
+#define GFX1993_FRAMESINK_H
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Framebuffer.h"
+
+namespace render {
+
+// Writes rendered frames to PPM files on a background thread, so that the
+// next frame can be rendered while the last one is written.
+//
+// The sink owns a fixed set of framebuffers. The caller takes a free one with
+// acquire(), renders into it and hands it back with submit(); the writer
+// thread writes the frames in submission order and then returns their
+// framebuffers to the free set. Once all framebuffers wait to be written,
+// acquire() blocks until the writer catches up, so rendering runs at most
+// bufferCount - 1 frames ahead of the disk.
+class FrameSink {
+public:
+  FrameSink(unsigned int width, unsigned int height,
+            PixelFormat format = PixelFormat::RGBA8,
+            unsigned int bufferCount = 3);
+
+  // Writes the remaining frames before returning.
+  ~FrameSink();
+
+  FrameSink(const FrameSink &) = delete;
+  FrameSink &operator=(const FrameSink &) = delete;
+
+  // A framebuffer to render the next frame into. Its contents are whatever
+  // was rendered into it last, so it needs to be cleared.
+  std::shared_ptr<Framebuffer> acquire();
+
+  // Queues a framebuffer from acquire() to be written to the given file. The
+  // caller must not touch the framebuffer until it gets it back from
+  // acquire().
+  void submit(const std::shared_ptr<Framebuffer> &framebuffer,
+              const std::string &filename);
+
+  // Blocks until all submitted frames are written.
+  void flush();
+
+  // Number of frames whose file could not be written.
+  unsigned int getWriteErrors();
+
+  inline unsigned int getBufferCount() const { return buffers.size(); }
+
+private:
+  struct Frame {
+    std::shared_ptr<Framebuffer> framebuffer;
+    std::string filename;
+  };
+
+  std::vector<std::shared_ptr<Framebuffer>> buffers;
+
+  // Guarded by the mutex.
+  std::mutex mutex;
+  std::condition_variable frameQueued;
+  std::condition_variable bufferFreed;
+  std::deque<std::shared_ptr<Framebuffer>> freeBuffers;
+  std::deque<Frame> queue;
+  bool writing;
+  unsigned int writeErrors;
+  bool shutdown;
+
+  std::thread writer;
+
+  void writerLoop();
+};
+
+} // namespace render
+
+#endif // GFX1993_FRAMESINK_H
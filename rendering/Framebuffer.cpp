@@ -1,24 +1,177 @@
 #include "Framebuffer.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
 namespace render {
 
-Framebuffer::Framebuffer(unsigned int w, unsigned int h) : width(w), height(h) {
-  data = new glm::vec4[width * height];
+static unsigned int getPixelSize(PixelFormat format) {
+  switch (format) {
+  case PixelFormat::RGBA8:
+    return 4;
+  case PixelFormat::RGB565:
+    return 2;
+  default:
+    return sizeof(glm::vec4);
+  }
 }
 
-Framebuffer::~Framebuffer() { delete[] data; }
+// Scales a color channel from [0, 1] to [0, max] with rounding.
+static inline unsigned int quantize(float c, float max) {
+  return (unsigned int)(glm::clamp(c, 0.f, 1.f) * max + 0.5f);
+}
+
+Framebuffer::Framebuffer(unsigned int w, unsigned int h, PixelFormat format,
+                         BufferLayout layout)
+    : width(w), height(h), format(format), layout(layout),
+      bytesPerPixel(getPixelSize(format)), linearData(nullptr),
+      tilesX((w + TILE_SIZE - 1) / TILE_SIZE),
+      tilesY((h + TILE_SIZE - 1) / TILE_SIZE) {
+  data = new unsigned char[getBufferSize(layout, width, height, tilesX,
+                                         tilesY) *
+                           bytesPerPixel];
+  clearPending = new unsigned char[tilesX * tilesY];
+  clear(glm::vec4(0.f));
+}
+
+Framebuffer::~Framebuffer() {
+  delete[] data;
+  delete[] linearData;
+  delete[] clearPending;
+}
+
+const void *Framebuffer::getData() const {
+  resolveClears();
+  if (layout == BufferLayout::LINEAR)
+    return data;
+
+  // Copy the tile rows to the image rows.
+  if (!linearData)
+    linearData = new unsigned char[width * height * bytesPerPixel];
+  for (unsigned int y = 0; y < height; ++y) {
+    for (unsigned int x = 0; x < width; x += TILE_SIZE) {
+      const unsigned int count = std::min(width - x, (unsigned int)TILE_SIZE);
+      memcpy(linearData + (x + y * width) * bytesPerPixel,
+             data + getPixelIndex(x, y) * bytesPerPixel,
+             count * bytesPerPixel);
+    }
+  }
+  return linearData;
+}
 
 void Framebuffer::clear(const glm::vec4 &c) {
-  for (unsigned int i = 0; i < width * height; ++i) {
-    data[i] = c;
+  // Pack the color once; the pixels are filled on first write, see
+  // resolveClear().
+  pack(c, clearPixel);
+  memset(clearPending, 1, tilesX * tilesY);
+}
+
+void Framebuffer::resolveClears() const {
+  const unsigned int tiles = tilesX * tilesY;
+  const unsigned int pending =
+      std::count(clearPending, clearPending + tiles, 1);
+  if (pending == tiles) {
+    fillClearPixel(data, getBufferSize(layout, width, height, tilesX, tilesY));
+    memset(clearPending, 0, tiles);
+  } else if (pending) {
+    for (unsigned int tile = 0; tile < tiles; ++tile) {
+      if (clearPending[tile])
+        resolveClear(tile);
+    }
+  }
+}
+
+void Framebuffer::resolveClear(unsigned int tile) const {
+  const unsigned int x0 = tile % tilesX * TILE_SIZE;
+  const unsigned int y0 = tile / tilesX * TILE_SIZE;
+  const unsigned int x1 = std::min(x0 + TILE_SIZE, width);
+  const unsigned int y1 = std::min(y0 + TILE_SIZE, height);
+
+  for (unsigned int y = y0; y < y1; ++y) {
+    fillClearPixel(data + getPixelIndex(x0, y) * bytesPerPixel, x1 - x0);
+  }
+  clearPending[tile] = 0;
+}
+
+void Framebuffer::fillClearPixel(unsigned char *pixels,
+                                 unsigned int count) const {
+  // Black, white and the like are the same byte over and over.
+  if (std::all_of(clearPixel + 1, clearPixel + bytesPerPixel,
+                  [this](unsigned char b) { return b == clearPixel[0]; })) {
+    memset(pixels, clearPixel[0], count * bytesPerPixel);
+    return;
+  }
+
+  // Otherwise fill with whole pixels, so that it can be vectorized.
+  switch (format) {
+  case PixelFormat::RGBA8: {
+    uint32_t v;
+    memcpy(&v, clearPixel, sizeof(v));
+    std::fill((uint32_t *)pixels, (uint32_t *)pixels + count, v);
+    break;
+  }
+  case PixelFormat::RGB565: {
+    uint16_t v;
+    memcpy(&v, clearPixel, sizeof(v));
+    std::fill((uint16_t *)pixels, (uint16_t *)pixels + count, v);
+    break;
+  }
+  default: {
+    glm::vec4 v;
+    memcpy(&v, clearPixel, sizeof(v));
+    std::fill((glm::vec4 *)pixels, (glm::vec4 *)pixels + count, v);
+    break;
+  }
   }
 }
 
 void Framebuffer::plot(int x, int y, const glm::vec4 &c) {
   if (x >= 0 && x < width && y >= 0 && y < height) {
-    const int index = x + y * width;
-    data[index] = c;
+    const unsigned int tile = getTileIndex(x, y);
+    if (clearPending[tile])
+      resolveClear(tile);
+
+    pack(c, data + getPixelIndex(x, y) * bytesPerPixel);
+  }
+}
+
+void Framebuffer::pack(const glm::vec4 &c, unsigned char *pixel) const {
+  switch (format) {
+  case PixelFormat::RGBA8:
+    pixel[0] = quantize(c.r, 255.f);
+    pixel[1] = quantize(c.g, 255.f);
+    pixel[2] = quantize(c.b, 255.f);
+    pixel[3] = quantize(c.a, 255.f);
+    break;
+  case PixelFormat::RGB565: {
+    const uint16_t v = quantize(c.r, 31.f) << 11 | quantize(c.g, 63.f) << 5 |
+                       quantize(c.b, 31.f);
+    memcpy(pixel, &v, sizeof(v));
+    break;
+  }
+  default:
+    memcpy(pixel, &c, sizeof(c));
+    break;
+  }
+}
+
+glm::vec4 Framebuffer::unpack(const unsigned char *pixel) const {
+  switch (format) {
+  case PixelFormat::RGBA8:
+    return glm::vec4(pixel[0], pixel[1], pixel[2], pixel[3]) / 255.f;
+  case PixelFormat::RGB565: {
+    uint16_t v;
+    memcpy(&v, pixel, sizeof(v));
+    return glm::vec4((v >> 11) / 31.f, ((v >> 5) & 63) / 63.f,
+                     (v & 31) / 31.f, 1.f);
+  }
+  default: {
+    glm::vec4 c;
+    memcpy(&c, pixel, sizeof(c));
+    return c;
+  }
   }
 }
 
-}
\ No newline at end of file
+} // namespace render
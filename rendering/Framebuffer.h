@@ -4,11 +4,35 @@
 #include <glm/glm.hpp>
 #include <memory>
 
+#include "BufferLayout.h"
+
 namespace render {
 
+// Storage format of the framebuffer pixels. Colors are packed when they are
+// written and unpacked when they are read, so everything outside of the
+// framebuffer keeps working with glm::vec4. The smaller formats clamp the
+// color channels to [0, 1].
+enum class PixelFormat {
+  // Four floats per pixel, 16 bytes; no conversion.
+  RGBA32F,
+  // Four bytes per pixel in R, G, B, A order.
+  RGBA8,
+  // Red, green and blue in 5, 6 and 5 bits of a 16 bit word, red in the
+  // highest bits; alpha always reads as 1.
+  RGB565
+};
+
+// An RGBA color buffer. Like the depth buffer, it is cleared lazily: clear()
+// only flags the TILE_SIZE x TILE_SIZE tiles, and a tile's pixels are filled
+// with the clear color when it is first written to. Reads of a flagged tile
+// return the clear color; getData() fills all tiles that are still flagged.
 class Framebuffer {
 public:
-  Framebuffer(unsigned int w, unsigned int h);
+  static const int TILE_SIZE = BUFFER_TILE_SIZE;
+
+  Framebuffer(unsigned int w, unsigned int h,
+              PixelFormat format = PixelFormat::RGBA32F,
+              BufferLayout layout = BufferLayout::LINEAR);
 
   Framebuffer(const Framebuffer &cp);
 
@@ -22,25 +46,72 @@ public:
 
   void plot(int x, int y, const glm::vec4 &c);
 
+  // Fills the pixels of all tiles that are still flagged by clear(). If all
+  // of them are, the whole buffer is filled at once.
+  void resolveClears() const;
+
   inline unsigned int getWidth() const { return width; }
 
   inline unsigned int getHeight() const { return height; }
 
-  inline const glm::vec4 &getPixel(const glm::ivec2 &p) const {
+  inline PixelFormat getFormat() const { return format; }
+
+  inline unsigned int getBytesPerPixel() const { return bytesPerPixel; }
+
+  inline BufferLayout getLayout() const { return layout; }
+
+  inline glm::vec4 getPixel(const glm::ivec2 &p) const {
     return getPixel(p.x, p.y);
   }
 
-  inline const glm::vec4 &getPixel(unsigned int x, unsigned int y) const {
-    return data[x + y * width];
+  inline glm::vec4 getPixel(unsigned int x, unsigned int y) const {
+    if (clearPending[getTileIndex(x, y)])
+      return unpack(clearPixel);
+    return unpack(data + getPixelIndex(x, y) * bytesPerPixel);
   }
 
-  inline const glm::vec4 *getPixels() const { return data; }
+  // The raw pixel data, row by row, in the framebuffer's format. With the
+  // tiled layout, the pixels are copied to a separate readback buffer first.
+  const void *getData() const;
 
 protected:
   unsigned int width, height;
-  glm::vec4 *data;
+  PixelFormat format;
+  BufferLayout layout;
+  unsigned int bytesPerPixel;
+  unsigned char *data;
+
+  // Row by row copy of the pixels for getData(); only used with the tiled
+  // layout, and allocated on first use.
+  mutable unsigned char *linearData;
+
+  // The clear color in the storage format, and a flag for every tile whose
+  // pixels still have to be set to it; one byte per tile, so that threads
+  // working on different tiles never share one.
+  unsigned char clearPixel[sizeof(glm::vec4)];
+  unsigned int tilesX, tilesY;
+  unsigned char *clearPending;
+
+  inline unsigned int getTileIndex(int x, int y) const {
+    return x / TILE_SIZE + tilesX * (y / TILE_SIZE);
+  }
+
+  inline unsigned int getPixelIndex(unsigned int x, unsigned int y) const {
+    return getBufferIndex(layout, x, y, width, tilesX);
+  }
+
+  // Fills count pixels with the clear color.
+  void fillClearPixel(unsigned char *pixels, unsigned int count) const;
+
+  // Fills the pixels of a tile flagged by clear() and removes the flag.
+  void resolveClear(unsigned int tile) const;
+
+  // Converts a color to and from the storage format.
+  void pack(const glm::vec4 &c, unsigned char *pixel) const;
+
+  glm::vec4 unpack(const unsigned char *pixel) const;
 };
 
 } // namespace render
 
-#endif
\ No newline at end of file
+#endif
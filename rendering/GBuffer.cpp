@@ -0,0 +1,36 @@
+#include "GBuffer.h"
+
+#include <cfloat>
+
+namespace render {
+
+const float GBuffer::EMPTY = FLT_MAX;
+
+GBuffer::GBuffer(unsigned int w, unsigned int h) : width(w), height(h) {
+  position = new glm::vec3[width * height];
+  normal = new glm::vec3[width * height];
+  color = new glm::vec4[width * height];
+  texcoord = new glm::vec2[width * height];
+  texcoordDerivatives = new glm::vec4[width * height];
+  depth = new float[width * height];
+  clear();
+}
+
+GBuffer::~GBuffer() {
+  delete[] position;
+  delete[] normal;
+  delete[] color;
+  delete[] texcoord;
+  delete[] texcoordDerivatives;
+  delete[] depth;
+}
+
+void GBuffer::clear() {
+  // Only depth tells whether a pixel is covered; the other channels are
+  // overwritten before they are read.
+  for (unsigned int i = 0; i < width * height; ++i) {
+    depth[i] = EMPTY;
+  }
+}
+
+} // namespace render
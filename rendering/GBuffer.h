@@ -0,0 +1,89 @@
+#ifndef GFX1993_GBUFFER_H
+#define GFX1993_GBUFFER_H
+
+#include <glm/glm.hpp>
+
+#include "Pipeline.h"
+
+namespace render {
+
+// The render targets of deferred shading: the shading geometry of the visible
+// surface of every pixel. Rasterization fills it without calling the fragment
+// shader; Rasterizer::shadeGBuffer() then shades every covered pixel exactly
+// once. Every attribute is stored in a channel of its own, row by row, so that
+// the shading pass reads each of them linearly.
+class GBuffer {
+public:
+  GBuffer(unsigned int w, unsigned int h);
+
+  GBuffer(const GBuffer &) = delete;
+  GBuffer &operator=(const GBuffer &) = delete;
+
+  virtual ~GBuffer();
+
+  // Marks all pixels as not covered.
+  virtual void clear();
+
+  inline unsigned int getWidth() const { return width; }
+  inline unsigned int getHeight() const { return height; }
+
+  // Stores the attributes of a fragment at its window coordinates.
+  inline void write(const ShadingGeometry &g) {
+    const unsigned int i = g.windowCoord.x + width * g.windowCoord.y;
+    position[i] = g.position;
+    normal[i] = g.normal;
+    color[i] = g.color;
+    texcoord[i] = g.texcoord;
+    texcoordDerivatives[i] = glm::vec4(g.texcoordDx, g.texcoordDy);
+    depth[i] = g.depth;
+  }
+
+  // Whether any fragment was written to pixel x, y since the last clear.
+  inline bool isCovered(unsigned int x, unsigned int y) const {
+    return depth[x + width * y] != EMPTY;
+  }
+
+  // The attributes stored at pixel x, y.
+  inline ShadingGeometry read(unsigned int x, unsigned int y) const {
+    const unsigned int i = x + width * y;
+    ShadingGeometry g;
+    g.position = position[i];
+    g.normal = normal[i];
+    g.color = color[i];
+    g.texcoord = texcoord[i];
+    const glm::vec4 &derivatives = texcoordDerivatives[i];
+    g.texcoordDx = glm::vec2(derivatives.x, derivatives.y);
+    g.texcoordDy = glm::vec2(derivatives.z, derivatives.w);
+    g.windowCoord = glm::ivec2(x, y);
+    g.depth = depth[i];
+    return g;
+  }
+
+  // Channels
+  inline const glm::vec3 *getPositions() const { return position; }
+  inline const glm::vec3 *getNormals() const { return normal; }
+  inline const glm::vec4 *getColors() const { return color; }
+  inline const glm::vec2 *getTexcoords() const { return texcoord; }
+  inline const glm::vec4 *getTexcoordDerivatives() const {
+    return texcoordDerivatives;
+  }
+  inline const float *getDepths() const { return depth; }
+
+protected:
+  // Depth of pixels that were not written to.
+  static const float EMPTY;
+
+  unsigned int width, height;
+
+  glm::vec3 *position;
+  glm::vec3 *normal;
+  glm::vec4 *color;
+  glm::vec2 *texcoord;
+  // x and y derivatives of the texture coordinates, in that order.
+  glm::vec4 *texcoordDerivatives;
+  float *depth;
+};
+
+} // namespace render
+
+#endif // GFX1993_GBUFFER_H
@@ -0,0 +1,194 @@
+#include "Image.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+
+#include <glm/glm.hpp>
+
+#include "Framebuffer.h"
+#include "MappedFile.h"
+
+namespace render {
+
+namespace {
+
+// Reads the PPM header and ASCII samples: decimal numbers separated by
+// whitespace, with comments from '#' to the end of the line.
+class Tokenizer {
+public:
+  Tokenizer(const unsigned char *begin, const unsigned char *end)
+      : p(begin), end(end) {}
+
+  bool readNumber(unsigned int &value) {
+    skipWhitespace();
+    if (p == end || !isdigit(*p))
+      return false;
+
+    value = 0;
+    while (p != end && isdigit(*p)) {
+      value = value * 10 + (*p++ - '0');
+      if (value > 0xffffff)
+        return false;
+    }
+    return true;
+  }
+
+  void skipWhitespace() {
+    while (p != end) {
+      if (*p == '#') {
+        while (p != end && *p != '\n')
+          ++p;
+      } else if (isspace(*p)) {
+        ++p;
+      } else {
+        break;
+      }
+    }
+  }
+
+  const unsigned char *p;
+  const unsigned char *end;
+};
+
+// Opens filename for writing and writes the header of a binary PPM. Returns
+// nullptr on failure.
+FILE *beginPPM(const std::string &filename, unsigned int width,
+               unsigned int height) {
+  FILE *file = fopen(filename.c_str(), "wb");
+  if (!file)
+    return nullptr;
+
+  if (fprintf(file, "P6\n%u %u\n255\n", width, height) < 0) {
+    fclose(file);
+    return nullptr;
+  }
+  return file;
+}
+
+} // namespace
+
+std::unique_ptr<Image> readPPM(const std::string &filename) {
+  const MappedFile file(filename);
+  const unsigned char *data = file.getData();
+  if (file.getSize() < 2 || data[0] != 'P' ||
+      (data[1] != '3' && data[1] != '6')) {
+    return nullptr;
+  }
+  const bool binary = data[1] == '6';
+
+  Tokenizer tokens(data + 2, data + file.getSize());
+  unsigned int width, height, maxValue;
+  if (!tokens.readNumber(width) || !tokens.readNumber(height) ||
+      !tokens.readNumber(maxValue) || width == 0 || height == 0 ||
+      maxValue == 0 || maxValue > 0xffff) {
+    return nullptr;
+  }
+
+  // The pixel data has to be in the file before anything is allocated for it.
+  const size_t samples = (size_t)width * height * 3;
+  const size_t bytesPerSample = maxValue > 255 ? 2 : 1;
+  const unsigned char *in = nullptr;
+  if (binary) {
+    // A single whitespace character separates the header from the samples,
+    // which take two bytes, most significant first, if they do not fit in
+    // one.
+    if (tokens.p == tokens.end || !isspace(*tokens.p) ||
+        (size_t)(tokens.end - tokens.p - 1) / bytesPerSample < samples) {
+      return nullptr;
+    }
+    in = tokens.p + 1;
+  } else if ((size_t)(tokens.end - tokens.p) / 2 < samples) {
+    // Every ASCII sample takes at least a digit and a separator.
+    return nullptr;
+  }
+
+  auto image = std::make_unique<Image>();
+  image->width = width;
+  image->height = height;
+  image->pixels.resize(samples);
+  unsigned char *out = image->pixels.data();
+
+  if (!binary) {
+    for (size_t i = 0; i < samples; ++i) {
+      unsigned int value;
+      if (!tokens.readNumber(value) || value > maxValue)
+        return nullptr;
+      out[i] = (value * 255 + maxValue / 2) / maxValue;
+    }
+    return image;
+  }
+
+  if (maxValue == 255) {
+    memcpy(out, in, samples);
+  } else if (bytesPerSample == 1) {
+    for (size_t i = 0; i < samples; ++i)
+      out[i] = (std::min<unsigned int>(in[i], maxValue) * 255 + maxValue / 2) /
+               maxValue;
+  } else {
+    for (size_t i = 0; i < samples; ++i) {
+      const unsigned int value =
+          std::min<unsigned int>(in[2 * i] << 8 | in[2 * i + 1], maxValue);
+      out[i] = (value * 255 + maxValue / 2) / maxValue;
+    }
+  }
+  return image;
+}
+
+bool writePPM(const std::string &filename, unsigned int width,
+              unsigned int height, const unsigned char *pixels) {
+  FILE *file = beginPPM(filename, width, height);
+  if (!file)
+    return false;
+
+  // The pixels go out straight from the caller's buffer.
+  const size_t samples = (size_t)width * height * 3;
+  const bool written = fwrite(pixels, 1, samples, file) == samples;
+  return fclose(file) == 0 && written;
+}
+
+bool writePPM(const std::string &filename, const Framebuffer &framebuffer) {
+  const unsigned int width = framebuffer.getWidth();
+  const unsigned int height = framebuffer.getHeight();
+  FILE *file = beginPPM(filename, width, height);
+  if (!file)
+    return false;
+
+  // Converted and written a row at a time, so that no copy of the whole frame
+  // is needed. Only linear RGBA8 buffers are read directly; getData() of a
+  // tiled one would copy the frame into rows first, so those go pixel by
+  // pixel like the other formats.
+  std::vector<unsigned char> row((size_t)width * 3);
+  const unsigned char *in =
+      framebuffer.getFormat() == PixelFormat::RGBA8 &&
+              framebuffer.getLayout() == BufferLayout::LINEAR
+          ? static_cast<const unsigned char *>(framebuffer.getData())
+          : nullptr;
+
+  bool written = true;
+  for (unsigned int y = 0; y < height && written; ++y) {
+    unsigned char *out = row.data();
+    if (in) {
+      // Already 8 bits per channel; only drop the alpha.
+      for (unsigned int x = 0; x < width; ++x, in += 4, out += 3) {
+        out[0] = in[0];
+        out[1] = in[1];
+        out[2] = in[2];
+      }
+    } else {
+      for (unsigned int x = 0; x < width; ++x, out += 3) {
+        const glm::vec4 c =
+            glm::clamp(framebuffer.getPixel(x, y), 0.f, 1.f) * 255.f + 0.5f;
+        out[0] = (unsigned char)c.r;
+        out[1] = (unsigned char)c.g;
+        out[2] = (unsigned char)c.b;
+      }
+    }
+    written = fwrite(row.data(), 1, row.size(), file) == row.size();
+  }
+
+  return fclose(file) == 0 && written;
+}
+
+} // namespace render
@@ -0,0 +1,41 @@
+#ifndef GFX1993_IMAGE_H
+#define GFX1993_IMAGE_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace render {
+
+class Framebuffer;
+
+// An RGB image with 8 bits per channel, as it is read from and written to
+// PPM files.
+struct Image {
+  unsigned int width = 0, height = 0;
+  // Pixels row by row, top to bottom, in R, G, B order.
+  std::vector<unsigned char> pixels;
+};
+
+// Reads a binary (P6) or ASCII (P3) PPM file. The file is mapped into memory
+// and binary pixel data is copied in one go. Samples with a maximum value
+// other than 255 are scaled to 8 bits. Returns nullptr if the file cannot be
+// read or is not a valid PPM.
+std::unique_ptr<Image> readPPM(const std::string &filename);
+
+// Writes a binary (P6) PPM file: the header, then the pixels straight from
+// the given buffer. Returns false if the file could not be written.
+bool writePPM(const std::string &filename, unsigned int width,
+              unsigned int height, const unsigned char *pixels);
+
+inline bool writePPM(const std::string &filename, const Image &image) {
+  return writePPM(filename, image.width, image.height, image.pixels.data());
+}
+
+// Writes the color channels of a framebuffer, rounded to 8 bits. They are
+// converted and written a row at a time.
+bool writePPM(const std::string &filename, const Framebuffer &framebuffer);
+
+} // namespace render
+
+#endif // GFX1993_IMAGE_H
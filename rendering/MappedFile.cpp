@@ -0,0 +1,33 @@
+#include "MappedFile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace render {
+
+MappedFile::MappedFile(const std::string &filename) {
+  const int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return;
+
+  struct stat st;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    void *mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped != MAP_FAILED) {
+      data = static_cast<const unsigned char *>(mapped);
+      size = st.st_size;
+      // Files are parsed front to back, once.
+      madvise(mapped, size, MADV_SEQUENTIAL);
+    }
+  }
+  close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (data)
+    munmap(const_cast<unsigned char *>(data), size);
+}
+
+} // namespace render
@@ -0,0 +1,32 @@
+#ifndef GFX1993_MAPPEDFILE_H
+#define GFX1993_MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+
+namespace render {
+
+// A read-only memory mapping of a whole file, for parsing it in place without
+// copying it through stream buffers first. The mapping is empty if the file
+// cannot be opened or mapped, or if it is empty.
+class MappedFile {
+public:
+  explicit MappedFile(const std::string &filename);
+
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  inline const unsigned char *getData() const { return data; }
+  inline size_t getSize() const { return size; }
+  inline bool isOpen() const { return data != nullptr; }
+
+private:
+  const unsigned char *data = nullptr;
+  size_t size = 0;
+};
+
+} // namespace render
+
+#endif // GFX1993_MAPPEDFILE_H
@@ -5,18 +5,18 @@
 using glm::vec4;
 
 namespace render {
-VertexOut &&lerp(const VertexOut &a, const VertexOut &b, float d) {
+VertexOut lerp(const VertexOut &a, const VertexOut &b, float d) {
   VertexOut result;
   result.clipPosition = glm::mix(a.clipPosition, b.clipPosition, d);
   result.worldPosition = glm::mix(a.worldPosition, b.worldPosition, d);
   result.worldNormal = glm::mix(a.worldNormal, b.worldNormal, d);
   result.color = glm::mix(a.color, b.color, d);
   result.texcoord = glm::mix(a.texcoord, b.texcoord, d);
-  return std::move(result);
+  return result;
 }
 
-ShadingGeometry &&interpolate(const ShadingGeometry &a,
-                              const ShadingGeometry &b, float d) {
+ShadingGeometry interpolate(const ShadingGeometry &a,
+                            const ShadingGeometry &b, float d) {
   ShadingGeometry result;
 
   result.position = mix(a.position, b.position, d);
@@ -25,28 +25,33 @@ ShadingGeometry &&interpolate(const ShadingGeometry &a,
   result.color = mix(a.color, b.color, d);
   result.windowCoord = mix(a.windowCoord, b.windowCoord, d);
 
-  return std::move(result);
+  return result;
 }
 
-ShadingGeometry &&PointPrimitive::rasterize() const {
+ShadingGeometry PointPrimitive::rasterize() const {
   ShadingGeometry result;
   result.position = p.worldPosition;
   result.normal = p.worldNormal;
   result.color = p.color;
   result.texcoord = p.texcoord;
-  return std::move(result);
+  return result;
 }
 
-ShadingGeometry &&LinePrimitive::rasterize(float d) const {
+ShadingGeometry LinePrimitive::rasterize(float d) const {
   ShadingGeometry result;
   result.position = mix(a.worldPosition, b.worldPosition, d);
   result.normal = normalize(mix(a.worldNormal, b.worldNormal, d));
   result.color = mix(a.color, b.color, d);
   result.texcoord = mix(a.texcoord, b.texcoord, d);
-  return std::move(result);
+  return result;
 }
 
-ShadingGeometry &&TrianglePrimitive::rasterize(const glm::vec3 &bary) const {
+ShadingGeometry TrianglePrimitive::rasterize(const glm::vec3 &bary) const {
+  return interpolate(a, b, c, bary);
+}
+
+ShadingGeometry interpolate(const VertexOut &a, const VertexOut &b,
+                            const VertexOut &c, const glm::vec3 &bary) {
   float bsum = bary.x + bary.y + bary.z;
 
   ShadingGeometry sgeo;
@@ -58,7 +63,7 @@ ShadingGeometry &&TrianglePrimitive::rasterize(const glm::vec3 &bary) const {
   sgeo.texcoord =
       a.texcoord * bary.x + b.texcoord * bary.y + c.texcoord * bary.z / bsum;
 
-  return std::move(sgeo);
+  return sgeo;
 }
 
 } // namespace render
@@ -57,14 +57,14 @@ struct VertexOut {
 };
 
 // Linearly interpolates between two vertexouts.
-VertexOut &&lerp(const VertexOut &a, const VertexOut &b, float d);
+VertexOut lerp(const VertexOut &a, const VertexOut &b, float d);
 
 struct PointPrimitive {
   VertexOut p;
 
   inline explicit PointPrimitive(const VertexOut &o) : p(o) {}
 
-  ShadingGeometry &&rasterize() const;
+  ShadingGeometry rasterize() const;
 };
 
 struct LinePrimitive {
@@ -73,7 +73,7 @@ struct LinePrimitive {
   inline LinePrimitive(const VertexOut &a_, const VertexOut &b_)
       : a(a_), b(b_){};
 
-  ShadingGeometry &&rasterize(float d) const;
+  ShadingGeometry rasterize(float d) const;
 };
 
 struct TrianglePrimitive {
@@ -83,7 +83,7 @@ struct TrianglePrimitive {
                            const VertexOut &c_)
       : a(a_), b(b_), c(c_) {}
 
-  ShadingGeometry &&rasterize(const glm::vec3 &bary) const;
+  ShadingGeometry rasterize(const glm::vec3 &bary) const;
 
   inline void setColor(const glm::vec4 &color) {
     a.color = color;
@@ -92,6 +92,12 @@ struct TrianglePrimitive {
   }
 };
 
+// A triangle that refers to its corners by index into a list of transformed
+// vertices instead of holding copies of them.
+struct IndexedTriangle {
+  unsigned int a, b, c;
+};
+
 // Shading Geometry is the input of a fragment shader.
 struct ShadingGeometry {
   // world position and normal
@@ -101,13 +107,23 @@ struct ShadingGeometry {
   glm::vec4 color;
   glm::vec2 texcoord;
 
+  // Screen-space derivatives of the texture coordinates: how much they change
+  // from one pixel to the next in x and y. Used to pick the mip level when
+  // sampling textures; zero for points and lines.
+  glm::vec2 texcoordDx = glm::vec2(0.f);
+  glm::vec2 texcoordDy = glm::vec2(0.f);
+
   glm::ivec2 windowCoord;
   float depth;
 };
 
 // Linearly interpolates between two ShadingGeometries.
-ShadingGeometry &&interpolate(const ShadingGeometry &a,
-                              const ShadingGeometry &b, float d);
+ShadingGeometry interpolate(const ShadingGeometry &a,
+                            const ShadingGeometry &b, float d);
+
+// Interpolates the corners of a triangle at the given barycentric coordinates.
+ShadingGeometry interpolate(const VertexOut &a, const VertexOut &b,
+                            const VertexOut &c, const glm::vec3 &bary);
 
 // Final fragment shader output that will be written into a framebuffer.
 struct Fragment {
@@ -128,6 +144,7 @@ typedef std::vector<VertexOut> VertexOutList;
 typedef std::vector<PointPrimitive> PointPrimitiveList;
 typedef std::vector<LinePrimitive> LinePrimitiveList;
 typedef std::vector<TrianglePrimitive> TrianglePrimitiveList;
+typedef std::vector<IndexedTriangle> IndexedTriangleList;
 }; // namespace render
 
 #endif // SRENDER_PIPELINE_H
@@ -0,0 +1,142 @@
+#include "RasterKernel.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace render {
+
+// Reference implementation; the SIMD kernels must produce bit-identical
+// results.
+static void coverageScalar(const TriangleSetup &setup, const int w[3],
+                           int count, SpanCoverage &out) {
+  out.mask = 0;
+  for (int i = 0; i < SPAN_WIDTH; ++i) {
+    const int w0 = w[0] + setup.stepX[0] * i;
+    const int w1 = w[1] + setup.stepX[1] * i;
+    const int w2 = w[2] + setup.stepX[2] * i;
+
+    if (i < count && w0 + setup.bias[0] >= 0 && w1 + setup.bias[1] >= 0 &&
+        w2 + setup.bias[2] >= 0) {
+      out.mask |= 1u << i;
+    }
+
+    out.lambda0[i] = (float)w0 * setup.invArea;
+    out.lambda1[i] = (float)w1 * setup.invArea;
+    out.lambda2[i] = (float)w2 * setup.invArea;
+    out.depth[i] = out.lambda0[i] * setup.depth[0] +
+                   out.lambda1[i] * setup.depth[1] +
+                   out.lambda2[i] * setup.depth[2];
+  }
+}
+
+#ifdef __SSE2__
+static void coverageSse2(const TriangleSetup &setup, const int w[3], int count,
+                         SpanCoverage &out) {
+  const __m128 invArea = _mm_set1_ps(setup.invArea);
+  const __m128 d0 = _mm_set1_ps(setup.depth[0]);
+  const __m128 d1 = _mm_set1_ps(setup.depth[1]);
+  const __m128 d2 = _mm_set1_ps(setup.depth[2]);
+
+  // Edge values of the first four pixels and the step to the next four.
+  __m128i e[3];
+  __m128i step[3];
+  __m128i bias[3];
+  for (int j = 0; j < 3; ++j) {
+    // There is no 32 bit multiply in SSE2, so build the ramp by hand.
+    e[j] = _mm_setr_epi32(w[j], w[j] + setup.stepX[j],
+                          w[j] + setup.stepX[j] * 2,
+                          w[j] + setup.stepX[j] * 3);
+    step[j] = _mm_set1_epi32(setup.stepX[j] * 4);
+    bias[j] = _mm_set1_epi32(setup.bias[j]);
+  }
+
+  unsigned int outside = 0;
+  for (int half = 0; half < SPAN_WIDTH; half += 4) {
+    // A pixel is outside if any of its biased edge values is negative, i.e.
+    // if the sign bit of their bitwise or is set.
+    const __m128i any =
+        _mm_or_si128(_mm_add_epi32(e[0], bias[0]),
+                     _mm_or_si128(_mm_add_epi32(e[1], bias[1]),
+                                  _mm_add_epi32(e[2], bias[2])));
+    outside |= _mm_movemask_ps(_mm_castsi128_ps(any)) << half;
+
+    const __m128 l0 = _mm_mul_ps(_mm_cvtepi32_ps(e[0]), invArea);
+    const __m128 l1 = _mm_mul_ps(_mm_cvtepi32_ps(e[1]), invArea);
+    const __m128 l2 = _mm_mul_ps(_mm_cvtepi32_ps(e[2]), invArea);
+    const __m128 z = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(l0, d0), _mm_mul_ps(l1, d1)), _mm_mul_ps(l2, d2));
+
+    _mm_store_ps(out.lambda0 + half, l0);
+    _mm_store_ps(out.lambda1 + half, l1);
+    _mm_store_ps(out.lambda2 + half, l2);
+    _mm_store_ps(out.depth + half, z);
+
+    for (int j = 0; j < 3; ++j) {
+      e[j] = _mm_add_epi32(e[j], step[j]);
+    }
+  }
+
+  const unsigned int inRange = (1u << count) - 1;
+  out.mask = ~outside & inRange;
+}
+#endif
+
+#ifdef GFX93_AVX2_KERNEL
+// Compiled with AVX2 enabled in RasterKernelAvx2.cpp.
+void coverageAvx2(const TriangleSetup &setup, const int w[3], int count,
+                  SpanCoverage &out);
+#endif
+
+bool isSupported(SimdKernel kernel) {
+  switch (kernel) {
+  case SimdKernel::AUTO:
+  case SimdKernel::SCALAR:
+    return true;
+  case SimdKernel::SSE2:
+#ifdef __SSE2__
+    return true;
+#else
+    return false;
+#endif
+  case SimdKernel::AVX2:
+#ifdef GFX93_AVX2_KERNEL
+    // Checks CPUID and whether the OS saves the AVX registers.
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+  }
+  return false;
+}
+
+CoverageKernel selectCoverageKernel(SimdKernel kernel) {
+  if (kernel == SimdKernel::AUTO) {
+    // CPUID does not change, so only ask once.
+    static const SimdKernel best =
+        isSupported(SimdKernel::AVX2)
+            ? SimdKernel::AVX2
+            : isSupported(SimdKernel::SSE2) ? SimdKernel::SSE2
+                                            : SimdKernel::SCALAR;
+    kernel = best;
+  }
+
+  if (!isSupported(kernel)) {
+    return coverageScalar;
+  }
+
+  switch (kernel) {
+#ifdef __SSE2__
+  case SimdKernel::SSE2:
+    return coverageSse2;
+#endif
+#ifdef GFX93_AVX2_KERNEL
+  case SimdKernel::AVX2:
+    return coverageAvx2;
+#endif
+  default:
+    return coverageScalar;
+  }
+}
+
+} // namespace render
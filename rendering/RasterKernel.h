@@ -0,0 +1,62 @@
+#ifndef GFX1993_RASTERKERNEL_H
+#define GFX1993_RASTERKERNEL_H
+
+namespace render {
+
+// Number of pixels a coverage kernel processes per call.
+static const int SPAN_WIDTH = 8;
+
+// Instruction sets the triangle coverage kernel is available for.
+enum class SimdKernel {
+  // Picks the widest kernel the CPU supports at runtime.
+  AUTO,
+  // Portable reference implementation.
+  SCALAR,
+  // 2x4 pixels per instruction; always available on x86-64.
+  SSE2,
+  // 8 pixels per instruction.
+  AVX2
+};
+
+// Per-triangle constants used by the coverage kernels.
+struct TriangleSetup {
+  // Increments of the three edge functions from one pixel to the next.
+  int stepX[3];
+  // Added to the edge values before testing them: 0 for edges that the pixels
+  // exactly on them belong to, -1 for the others. Of two triangles sharing an
+  // edge only one of them covers the pixels on it.
+  int bias[3];
+  // Reciprocal of the edge function sum, i.e. of twice the triangle area.
+  float invArea;
+  // Window-space depth of the three corners.
+  float depth[3];
+};
+
+// Coverage and interpolation results for a span of pixels in a row.
+struct SpanCoverage {
+  // Bit i is set if pixel i of the span is inside the triangle.
+  unsigned int mask;
+
+  // Normalized barycentric coordinates and depth of every pixel.
+  alignas(32) float lambda0[SPAN_WIDTH];
+  alignas(32) float lambda1[SPAN_WIDTH];
+  alignas(32) float lambda2[SPAN_WIDTH];
+  alignas(32) float depth[SPAN_WIDTH];
+};
+
+// Evaluates up to SPAN_WIDTH consecutive pixels of a row. w holds the values of
+// the three edge functions at the first pixel; pixels at or beyond count are
+// never reported as covered.
+typedef void (*CoverageKernel)(const TriangleSetup &setup, const int w[3],
+                               int count, SpanCoverage &out);
+
+// Returns the kernel for the given instruction set. Falls back to the scalar
+// kernel if the CPU does not support the requested one.
+CoverageKernel selectCoverageKernel(SimdKernel kernel);
+
+// Returns true if the kernel can run on this CPU.
+bool isSupported(SimdKernel kernel);
+
+} // namespace render
+
+#endif // GFX1993_RASTERKERNEL_H
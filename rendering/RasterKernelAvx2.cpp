@@ -0,0 +1,50 @@
+#include "RasterKernel.h"
+
+// This file is compiled with AVX2 code generation enabled; see
+// CMakeLists.txt. Its kernel must only be called after checking CPU support.
+#ifdef GFX93_AVX2_KERNEL
+
+#include <immintrin.h>
+
+namespace render {
+
+void coverageAvx2(const TriangleSetup &setup, const int w[3], int count,
+                  SpanCoverage &out) {
+  const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256 invArea = _mm256_set1_ps(setup.invArea);
+
+  __m256i e[3];
+  __m256 l[3];
+  for (int j = 0; j < 3; ++j) {
+    e[j] = _mm256_add_epi32(
+        _mm256_set1_epi32(w[j]),
+        _mm256_mullo_epi32(_mm256_set1_epi32(setup.stepX[j]), lanes));
+    l[j] = _mm256_mul_ps(_mm256_cvtepi32_ps(e[j]), invArea);
+  }
+
+  // Separate multiply and add (no FMA) to match the scalar kernel exactly.
+  const __m256 z = _mm256_add_ps(
+      _mm256_add_ps(_mm256_mul_ps(l[0], _mm256_set1_ps(setup.depth[0])),
+                    _mm256_mul_ps(l[1], _mm256_set1_ps(setup.depth[1]))),
+      _mm256_mul_ps(l[2], _mm256_set1_ps(setup.depth[2])));
+
+  _mm256_store_ps(out.lambda0, l[0]);
+  _mm256_store_ps(out.lambda1, l[1]);
+  _mm256_store_ps(out.lambda2, l[2]);
+  _mm256_store_ps(out.depth, z);
+
+  // A pixel is outside if the sign bit of any of its biased edge values is
+  // set.
+  __m256i any = _mm256_setzero_si256();
+  for (int j = 0; j < 3; ++j) {
+    any = _mm256_or_si256(
+        any, _mm256_add_epi32(e[j], _mm256_set1_epi32(setup.bias[j])));
+  }
+  const unsigned int outside = _mm256_movemask_ps(_mm256_castsi256_ps(any));
+
+  out.mask = ~outside & ((1u << count) - 1);
+}
+
+} // namespace render
+
+#endif // GFX93_AVX2_KERNEL
@@ -1,12 +1,15 @@
 #include "Rasterizer.h"
 #include "Depthbuffer.h"
 #include "Framebuffer.h"
+#include "GBuffer.h"
 #include "Viewport.h"
 
 #include "Pipeline.h"
+#include "RasterKernel.h"
 #include "Shader.h"
 
 #include <algorithm>
+#include <cfloat>
 #include <glm/gtx/io.hpp>
 #include <glm/gtx/transform.hpp>
 #include <iostream>
@@ -18,6 +21,9 @@ using glm::vec4;
 
 using namespace render;
 
+Rasterizer::Rasterizer(unsigned int threadCount)
+    : threadCount(std::max(threadCount, 1u)) {}
+
 void Rasterizer::drawPoints(const RenderConfig &renderConfig,
                             const VertexList &vertices,
                             const IndexList &indices) const {
@@ -27,7 +33,7 @@ void Rasterizer::drawPoints(const RenderConfig &renderConfig,
 
   // Vertex transform.
   VertexOutList transformedVertices =
-      transformVertices(vertices, renderConfig.vertexShader);
+      transformVertices(renderConfig, vertices);
 
   // Primitive assembly
   PointPrimitiveList points;
@@ -69,22 +75,159 @@ void Rasterizer::drawPoints(const RenderConfig &renderConfig,
   }
 }
 
-VertexOutList Rasterizer::transformVertices(
-    const VertexList &vertices,
-    std::shared_ptr<VertexShader> vertexShader) const {
-  assert(vertexShader);
+// Number of vertices a worker transforms in one go when vertex processing is
+// spread over several threads. Keep it a multiple of four so the vector path
+// of the vertex shader sees the same groups no matter how many threads run.
+static const size_t VERTEX_CHUNK_SIZE = 4096;
+
+VertexOutList Rasterizer::transformVertices(const RenderConfig &renderConfig,
+                                            const VertexList &vertices) const {
   VertexOutList out(vertices.size());
-  std::transform(vertices.begin(), vertices.end(), out.begin(),
-                 [vertexShader](const auto &v) {
-                   return vertexShader->transformSingle(v);
-                 });
+  transformVertices(renderConfig, vertices.data(), out.data(), vertices.size());
   return out;
 }
 
-static inline bool insideClipSpace(const VertexOut &v) {
-  return v.clipPosition.x >= -1 && v.clipPosition.x <= 1 &&
-         v.clipPosition.y >= -1 && v.clipPosition.y <= 1 &&
-         v.clipPosition.z >= -1 && v.clipPosition.z <= 1;
+void Rasterizer::transformVertices(const RenderConfig &renderConfig,
+                                   const Vertex *in, VertexOut *out,
+                                   size_t count) const {
+  assert(renderConfig.vertexShader);
+  VertexShader &vertexShader = *renderConfig.vertexShader;
+
+  debugInfo.verticesTransformed += count;
+
+  if (!renderConfig.threadedVertexProcessing || count <= VERTEX_CHUNK_SIZE) {
+    vertexShader.transformBatch(in, out, count);
+    return;
+  }
+
+  const size_t chunks = (count + VERTEX_CHUNK_SIZE - 1) / VERTEX_CHUNK_SIZE;
+  getWorkers().parallelFor(chunks, [&](size_t chunk) {
+    const size_t first = chunk * VERTEX_CHUNK_SIZE;
+    vertexShader.transformBatch(in + first, out + first,
+                                std::min(VERTEX_CHUNK_SIZE, count - first));
+  });
+}
+
+const VertexOutList &
+Rasterizer::transformVertexBuffer(const RenderConfig &renderConfig,
+                                  const VertexBuffer &buffer) const {
+  assert(renderConfig.vertexShader);
+  VertexBuffer::TransformCache &cache = buffer.transformCache;
+
+  const VertexShader &shader = *renderConfig.vertexShader;
+  std::vector<float> state = shader.getTransformState();
+  const bool reusable = cache.valid && shader.isTransformCacheable() &&
+                        cache.shaderId == shader.getId() &&
+                        cache.state == state;
+
+  // Only the dirty range needs to be redone if the transform is the same as
+  // last time; this includes everything appended since then.
+  size_t begin = 0, end = buffer.size();
+  if (reusable) {
+    begin = std::min(buffer.getDirtyBegin(), buffer.size());
+    end = std::min(buffer.getDirtyEnd(), buffer.size());
+  }
+
+  cache.vertices.resize(buffer.size());
+  if (begin < end) {
+    transformVertices(renderConfig, buffer.getVertices().data() + begin,
+                      cache.vertices.data() + begin, end - begin);
+  }
+
+  cache.shaderId = shader.getId();
+  cache.state = std::move(state);
+  cache.valid = true;
+  buffer.clearDirty();
+
+  return cache.vertices;
+}
+
+// Marks vertices that no index refers to.
+static const unsigned int UNUSED_VERTEX = ~0u;
+
+const IndexList &Rasterizer::transformIndexedVertices(
+    const RenderConfig &renderConfig, const VertexList &vertices,
+    const IndexList &indices, VertexOutList &transformed,
+    IndexList &remappedIndices) const {
+  // Find the vertices that are actually referenced.
+  std::vector<unsigned int> cacheSlots(vertices.size(), UNUSED_VERTEX);
+  size_t usedVertices = 0;
+  for (unsigned int index : indices) {
+    if (index >= vertices.size()) {
+      std::cerr << "Index out of range!\n";
+      transformed.clear();
+      remappedIndices.clear();
+      return remappedIndices;
+    }
+    if (cacheSlots[index] == UNUSED_VERTEX) {
+      cacheSlots[index] = 0;
+      ++usedVertices;
+    }
+  }
+
+  // The common case -- nothing to skip, so the indices can be used as they
+  // are.
+  if (usedVertices == vertices.size()) {
+    transformed = transformVertices(renderConfig, vertices);
+    return indices;
+  }
+
+  // Compact the referenced vertices, keeping their order for fetch locality,
+  // and point the indices at their cache slots.
+  VertexList used;
+  used.reserve(usedVertices);
+  for (size_t i = 0; i < vertices.size(); ++i) {
+    if (cacheSlots[i] != UNUSED_VERTEX) {
+      cacheSlots[i] = used.size();
+      used.push_back(vertices[i]);
+    }
+  }
+
+  remappedIndices.resize(indices.size());
+  for (size_t i = 0; i < indices.size(); ++i) {
+    remappedIndices[i] = cacheSlots[indices[i]];
+  }
+
+  transformed = transformVertices(renderConfig, used);
+  return remappedIndices;
+}
+
+WorkerPool &Rasterizer::getWorkers() const {
+  if (!workers) {
+    workers = std::make_unique<WorkerPool>(threadCount);
+  }
+  return *workers;
+}
+
+// Window coordinates of triangles that are rasterized without clipping them
+// against the sides of the view volume stay within +-GUARD_BAND pixels. The
+// edge functions are evaluated in 32 bit integers; this keeps them from
+// overflowing.
+static const float GUARD_BAND = 8192.f;
+
+// Returns how far x and y may reach beyond the view volume before triangles
+// need to be clipped, as a multiple of w. A guard band of 1 is the view volume
+// itself.
+static glm::vec2 calculateGuardBand(const RenderConfig &renderConfig) {
+  if (!renderConfig.guardBandClipping)
+    return glm::vec2(1.f);
+
+  const Viewport &viewport = *renderConfig.viewport;
+  const glm::vec2 size(viewport.size);
+  const glm::vec2 far = glm::vec2(viewport.origin) + size;
+  return glm::max(glm::vec2(1.f), 2.f * (GUARD_BAND - far) / size);
+}
+
+// Returns a value that is positive if the triangle faces the viewer, i.e. if
+// its corners will be counter-clockwise on screen, and negative if it faces
+// away. This is the determinant of the x, y and w coordinates, which gives the
+// right answer before clipping, even if some corners are behind the viewer.
+static inline float calculateFacing(const VertexOut &a, const VertexOut &b,
+                                    const VertexOut &c) {
+  const vec3 pa(a.clipPosition.x, a.clipPosition.y, a.clipPosition.w);
+  const vec3 pb(b.clipPosition.x, b.clipPosition.y, b.clipPosition.w);
+  const vec3 pc(c.clipPosition.x, c.clipPosition.y, c.clipPosition.w);
+  return glm::dot(pa, glm::cross(pb, pc));
 }
 
 void Rasterizer::drawLines(const RenderConfig &renderConfig,
@@ -96,9 +239,31 @@ void Rasterizer::drawLines(const RenderConfig &renderConfig,
   }
 
   // Vertex transformation
-  VertexOutList transformedVertices =
-      transformVertices(vertices, renderConfig.vertexShader);
+  drawTransformedLines(renderConfig, transformVertices(renderConfig, vertices),
+                       indices);
+}
 
+void Rasterizer::drawLines(const RenderConfig &renderConfig,
+                           const VertexBuffer &vertices,
+                           const IndexBuffer &indices) const {
+  if (!renderConfig.isValid()) {
+    std::cerr << "Invalid render configuration!\n";
+    return;
+  }
+
+  if (indices.getRequiredVertexCount() > vertices.size()) {
+    std::cerr << "Index out of range!\n";
+    return;
+  }
+
+  drawTransformedLines(renderConfig,
+                       transformVertexBuffer(renderConfig, vertices),
+                       indices.getIndices());
+}
+
+void Rasterizer::drawTransformedLines(const RenderConfig &renderConfig,
+                                      const VertexOutList &transformedVertices,
+                                      const IndexList &indices) const {
   // Primitive assembly
   LinePrimitiveList lines;
   for (size_t i = 0; i < indices.size(); i += 2) {
@@ -152,40 +317,199 @@ void Rasterizer::drawTriangles(const RenderConfig &renderConfig,
     return;
   }
 
-  // transform vertices
-  VertexOutList transformedVertices =
-      transformVertices(vertices, renderConfig.vertexShader);
+  // Vertex processing. From here on, triangles refer to the transformed
+  // vertices by index.
+  VertexOutList transformedVertices;
+  IndexList remappedIndices;
+  const IndexList &cachedIndices = transformIndexedVertices(
+      renderConfig, vertices, indices, transformedVertices, remappedIndices);
+
+  drawTransformedTriangles(renderConfig, transformedVertices, cachedIndices);
+}
+
+void Rasterizer::drawTriangles(const RenderConfig &renderConfig,
+                               const VertexBuffer &vertices,
+                               const IndexBuffer &indices) const {
+  if (!renderConfig.isValid()) {
+    std::cerr << "Invalid render configuration!\n";
+    return;
+  }
 
-  // Primitive assembly.
-  TrianglePrimitiveList triangles;
+  if (indices.getRequiredVertexCount() > vertices.size()) {
+    std::cerr << "Index out of range!\n";
+    return;
+  }
+
+  // The buffer keeps all of its vertices transformed, referenced or not, so
+  // that they can be reused by the next draw.
+  drawTransformedTriangles(renderConfig,
+                           transformVertexBuffer(renderConfig, vertices),
+                           indices.getIndices());
+}
+
+void Rasterizer::drawTransformedTriangles(
+    const RenderConfig &renderConfig, const VertexOutList &transformedVertices,
+    const IndexList &indices) const {
+  // Primitive assembly, culling and clipping. Triangles that need no clipping
+  // keep pointing at the transformed vertices, which are left untouched. All
+  // others are clipped; the corners of the clipped triangles are indexed after
+  // the transformed vertices.
+  //
+  // Every vertex gets two outcodes: the low byte against the view volume, the
+  // high byte against the guard band.
+  const glm::vec2 guardBand = calculateGuardBand(renderConfig);
+  outcodes.resize(transformedVertices.size());
+  for (size_t i = 0; i < transformedVertices.size(); ++i) {
+    const vec4 &p = transformedVertices[i].clipPosition;
+    outcodes[i] = Clipper::computeOutcode(p) |
+                  Clipper::computeOutcode(p, guardBand) << 8;
+  }
+
+  clippedVertices.clear();
+  const TriangleVertices vertices{transformedVertices, clippedVertices};
+  IndexedTriangleList triangles;
+  triangles.reserve(indices.size() / 3);
   // https://www.gamasutra.com/view/news/168577/Indepth_Software_rasterizer_and_triangle_clipping.php
   // https://fgiesen.wordpress.com/2011/07/05/a-trip-through-the-graphics-pipeline-2011-part-5/
-  for (size_t i = 0; i < indices.size(); i += 3) {
-    const VertexOut &a = transformedVertices[indices[i + 0]];
-    const VertexOut &b = transformedVertices[indices[i + 1]];
-    const VertexOut &c = transformedVertices[indices[i + 2]];
-    triangles.push_back(TrianglePrimitive(a, b, c));
-  }
+  for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+    IndexedTriangle t{indices[i + 0], indices[i + 1], indices[i + 2]};
 
-  // At this point all triangles are in clip space [-1 .. 1] and can be clipped
-  // to NDC.
-  TrianglePrimitiveList clipped = clipper.clipTrianglesToNdc(triangles);
+    // Trivial reject -- all corners are outside of the same side.
+    const unsigned int ndcCodes =
+        outcodes[t.a] & outcodes[t.b] & outcodes[t.c] & Clipper::OUTSIDE_ANY;
+    if (ndcCodes)
+      continue;
 
-  // Perspective divide
-  for (auto &triangle : clipped) {
-    triangle.a.clipPosition /= triangle.a.clipPosition.w;
-    triangle.b.clipPosition /= triangle.b.clipPosition.w;
-    triangle.c.clipPosition /= triangle.c.clipPosition.w;
+    // Face culling -- done before clipping so that culled triangles never get
+    // there. The rasterizer only fills counter-clockwise triangles, so back
+    // faces that are kept are turned around.
+    const float facing =
+        calculateFacing(transformedVertices[t.a], transformedVertices[t.b],
+                        transformedVertices[t.c]);
+    if ((renderConfig.cullMode == CullMode::BACK && facing <= 0) ||
+        (renderConfig.cullMode == CullMode::FRONT && facing >= 0)) {
+      ++debugInfo.trianglesCulled;
+      continue;
+    }
+    if (facing < 0) {
+      std::swap(t.b, t.c);
+    }
 
-    // Add backface culling here
+    // Trivial accept -- all corners are within the guard band.
+    const unsigned int codes = outcodes[t.a] | outcodes[t.b] | outcodes[t.c];
+    if (!(codes >> 8)) {
+      triangles.push_back(t);
+      continue;
+    }
+
+    // At this point the triangle is in clip space and needs to be clipped.
+    // With a guard band, clipping against the near and far plane is usually
+    // enough; the rest is cut off by the bounding box of the rasterizer.
+    ++debugInfo.trianglesClipped;
+    unsigned int first = transformedVertices.size() + clippedVertices.size();
+    const unsigned int clipped = Clipper::clipTriangleToNdc(
+        transformedVertices[t.a], transformedVertices[t.b],
+        transformedVertices[t.c], codes & Clipper::OUTSIDE_ANY, guardBand,
+        clippedVertices);
+
+    for (unsigned int j = 0; j < clipped; ++j, first += 3) {
+      triangles.push_back(IndexedTriangle{first, first + 1, first + 2});
+    }
   }
 
-  for (const TrianglePrimitive &triangle : clipped) {
-    drawTriangle(renderConfig, triangle);
+  if (renderConfig.tiledRasterization) {
+    drawTrianglesTiled(renderConfig, vertices, triangles);
+    debugInfo.trianglesDrawn += triangles.size();
+    return;
+  }
+
+  const Viewport &viewport = *renderConfig.viewport;
+  for (const IndexedTriangle &t : triangles) {
+    drawTriangle(renderConfig, vertices[t.a], vertices[t.b], vertices[t.c],
+                 viewport.origin, viewport.origin + viewport.size - 1);
     ++debugInfo.trianglesDrawn;
   }
 }
 
+// Perspective divide and viewport transform of a clip-space position. Done
+// per triangle corner so that the transformed vertices can stay in clip space
+// and be shared between draws.
+static inline vec3 calculateWindowCoordinates(const Viewport &viewport,
+                                              const vec4 &clipPosition) {
+  return viewport.calculateWindowCoordinates(vec3(clipPosition) /
+                                             clipPosition.w);
+}
+
+// Calculates the window-space bounding box of a triangle, clamped to the
+// viewport. The box is empty if min > max along any axis.
+static void calculateTriangleBounds(const Viewport &viewport,
+                                    const VertexOut &va, const VertexOut &vb,
+                                    const VertexOut &vc, ivec2 &min,
+                                    ivec2 &max) {
+  ivec2 a = ivec2(calculateWindowCoordinates(viewport, va.clipPosition));
+  ivec2 b = ivec2(calculateWindowCoordinates(viewport, vb.clipPosition));
+  ivec2 c = ivec2(calculateWindowCoordinates(viewport, vc.clipPosition));
+
+  min = glm::min(a, glm::min(b, c));
+  max = glm::max(a, glm::max(b, c));
+
+  min = glm::max(viewport.origin, min);
+  max = glm::min(viewport.origin + viewport.size - 1, max);
+}
+
+void Rasterizer::drawTrianglesTiled(
+    const RenderConfig &renderConfig, const TriangleVertices &vertices,
+    const IndexedTriangleList &triangles) const {
+  const Viewport &viewport = *renderConfig.viewport;
+  const ivec2 viewportMax = viewport.origin + viewport.size - 1;
+
+  // Tiles are aligned to the tiles of the depth buffer and framebuffer, so that
+  // no two threads ever update the bounds or clear flags of the same tile.
+  static_assert(Framebuffer::TILE_SIZE == Depthbuffer::TILE_SIZE,
+                "Frame and depth buffer tiles must match");
+  const int depthTileSize = Depthbuffer::TILE_SIZE;
+  const int tileSize =
+      (std::max(renderConfig.tileSize, 1) + depthTileSize - 1) /
+      depthTileSize * depthTileSize;
+  const ivec2 firstTile = viewport.origin / tileSize;
+  const ivec2 tileCount = viewportMax / tileSize - firstTile + 1;
+
+  // Binning -- every tile gets the indices of the triangles whose bounding box
+  // overlaps it.
+  std::vector<std::vector<unsigned int>> bins(tileCount.x * tileCount.y);
+  for (size_t i = 0; i < triangles.size(); ++i) {
+    const IndexedTriangle &t = triangles[i];
+    ivec2 min, max;
+    calculateTriangleBounds(viewport, vertices[t.a], vertices[t.b],
+                            vertices[t.c], min, max);
+    if (min.x > max.x || min.y > max.y)
+      continue;
+
+    const ivec2 first = min / tileSize - firstTile;
+    const ivec2 last = max / tileSize - firstTile;
+    for (int y = first.y; y <= last.y; ++y) {
+      for (int x = first.x; x <= last.x; ++x) {
+        bins[x + y * tileCount.x].push_back(i);
+      }
+    }
+  }
+
+  // Rasterization -- tiles cover disjoint parts of the frame and depth buffer,
+  // so they can be drawn without any synchronization.
+  getWorkers().parallelFor(bins.size(), [&](size_t tile) {
+    const ivec2 tileOrigin =
+        (firstTile + ivec2(tile % tileCount.x, tile / tileCount.x)) * tileSize;
+    const ivec2 tileMin = glm::max(tileOrigin, viewport.origin);
+    const ivec2 tileMax = glm::min(tileOrigin + tileSize - 1, viewportMax);
+
+    for (unsigned int i : bins[tile]) {
+      const IndexedTriangle &t = triangles[i];
+      drawTriangle(renderConfig, vertices[t.a], vertices[t.b], vertices[t.c],
+                   tileMin, tileMax);
+    }
+  });
+}
+
 // Bresenham line drawing
 void Rasterizer::drawLine(const RenderConfig &renderConfig,
                           const LinePrimitive &line) const {
@@ -237,132 +561,435 @@ void Rasterizer::drawLine(const RenderConfig &renderConfig,
   }
 }
 
-// Finds which part of the half-space of line a-b point c is in (positive or
-// negative)
-static inline int pointInHalfspace(const glm::ivec2 &a, const glm::ivec2 &b,
-                                   const glm::ivec2 &c) {
-  return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
-}
+// The edge function of the line a-b. Its sign tells which part of the
+// half-space of the line a point is in (positive or negative). As it is linear
+// in x and y, it is stored as e(p) = stepX * p.x + stepY * p.y + offset so that
+// it can be stepped from pixel to pixel instead of being recomputed.
+//
+// Pixels exactly on the line (e(p) == 0) are inside only if the function
+// grows along x, or along y for lines parallel to the x axis. A triangle
+// sharing the edge sees it the other way round, so the pixels on it are drawn
+// once rather than by both triangles.
+struct EdgeFunction {
+  int stepX, stepY, offset, bias;
+
+  inline EdgeFunction(const glm::ivec2 &a, const glm::ivec2 &b)
+      : stepX(a.y - b.y), stepY(b.x - a.x),
+        offset((b.y - a.y) * a.x - (b.x - a.x) * a.y),
+        bias(stepX > 0 || (stepX == 0 && stepY > 0) ? 0 : -1) {}
+
+  inline int evaluate(int x, int y) const {
+    return stepX * x + stepY * y + offset;
+  }
+
+  inline bool isInside(int value) const { return value + bias >= 0; }
+};
+
+// Size of the square pixel blocks that are tested against the triangle edges
+// as a whole before looking at single pixels. Every block row is handed to the
+// coverage kernel as one span. Blocks are aligned to the tiles of the depth
+// buffer, so that they can be tested against the tile's depth bounds, too.
+static const int BLOCK_SIZE = SPAN_WIDTH;
+static_assert(BLOCK_SIZE == Depthbuffer::TILE_SIZE,
+              "Blocks must match the depth buffer tiles");
+
+// Margin for comparing interpolated depth values against the tile bounds of
+// the depth buffer, covering rounding differences to the per-pixel values.
+static const float DEPTH_EPSILON = 1e-5f;
 
 // Parameter-based rasterization of triangles. It calculates the screen-space
 // bounding box of the triangle, then checks every contained pixel whether it's
 // in the triangle or not. If the fragment is inside, it proceeds to the depth
 // test and shading stage.
 void Rasterizer::drawTriangle(const RenderConfig &renderConfig,
-                              const TrianglePrimitive &t) const {
+                              const VertexOut &va, const VertexOut &vb,
+                              const VertexOut &vc, const glm::ivec2 &clipMin,
+                              const glm::ivec2 &clipMax) const {
   assert(renderConfig.fragmentShader);
 
   using namespace glm;
 
-  const vec3 posA_win =
-      renderConfig.viewport->calculateWindowCoordinates(t.a.clipPosition);
-  const vec3 posB_win =
-      renderConfig.viewport->calculateWindowCoordinates(t.b.clipPosition);
-  const vec3 posC_win =
-      renderConfig.viewport->calculateWindowCoordinates(t.c.clipPosition);
+  const Viewport &viewport = *renderConfig.viewport;
+  const vec3 posA_win = calculateWindowCoordinates(viewport, va.clipPosition);
+  const vec3 posB_win = calculateWindowCoordinates(viewport, vb.clipPosition);
+  const vec3 posC_win = calculateWindowCoordinates(viewport, vc.clipPosition);
 
   // three window/screen coordinates
   ivec2 a = ivec2(posA_win);
   ivec2 b = ivec2(posB_win);
   ivec2 c = ivec2(posC_win);
 
-  // calculate bounds
-  ivec2 min, max;
-  min.x = glm::min(a.x, glm::min(b.x, c.x));
-  min.y = glm::min(a.y, glm::min(b.y, c.y));
-  max.x = glm::max(a.x, glm::max(b.x, c.x));
-  max.y = glm::max(a.y, glm::max(b.y, c.y));
+  // calculate bounds, clipped against the viewport
+  ivec2 bboxMin, bboxMax;
+  calculateTriangleBounds(viewport, va, vb, vc, bboxMin, bboxMax);
 
-  // clip against screen coords
-  min = glm::max(renderConfig.viewport->origin, min);
-  max = glm::min(
-      renderConfig.viewport->origin + renderConfig.viewport->size - 1, max);
+  // and against the region we are allowed to touch
+  const ivec2 min = glm::max(clipMin, bboxMin);
+  const ivec2 max = glm::min(clipMax, bboxMax);
 
-  if (renderConfig.drawTriangleBounds && renderConfig.framebuffer) {
+  // Depth-only rendering writes depth without shading; the second step of a
+  // depth pre-pass shades only the fragments that wrote it.
+  const bool depthOnly =
+      (!renderConfig.framebuffer && !renderConfig.gbuffer) ||
+      renderConfig.depthPass == DepthPass::DEPTH_ONLY;
+  const bool depthEqual = renderConfig.depthPass == DepthPass::SHADE_VISIBLE;
+
+  if (renderConfig.drawTriangleBounds && renderConfig.framebuffer &&
+      !depthOnly) {
     // draw bounding box
     vec4 bboxColour(1, 0, 0, 1);
     for (int x = min.x; x <= max.x; ++x) {
-      ivec2 p(x, min.y);
-      renderConfig.framebuffer->plot(p, bboxColour);
-      p = ivec2(x, max.y);
-      renderConfig.framebuffer->plot(p, bboxColour);
+      if (bboxMin.y == min.y)
+        renderConfig.framebuffer->plot(ivec2(x, bboxMin.y), bboxColour);
+      if (bboxMax.y == max.y)
+        renderConfig.framebuffer->plot(ivec2(x, bboxMax.y), bboxColour);
     }
 
     for (int y = min.y; y <= max.y; ++y) {
-      ivec2 p(min.x, y);
-      renderConfig.framebuffer->plot(p, bboxColour);
-      p = ivec2(max.x, y);
-      renderConfig.framebuffer->plot(p, bboxColour);
+      if (bboxMin.x == min.x)
+        renderConfig.framebuffer->plot(ivec2(bboxMin.x, y), bboxColour);
+      if (bboxMax.x == max.x)
+        renderConfig.framebuffer->plot(ivec2(bboxMax.x, y), bboxColour);
     }
   }
 
-  // Rasterize -- loop over the screen-space bounding box.
-  for (int y = min.y; y <= max.y; ++y) {
-    for (int x = min.x; x <= max.x; ++x) {
-      // position
-      ivec2 p(x, y);
-
-      int w0 = pointInHalfspace(b, c, p);
-      int w1 = pointInHalfspace(c, a, p);
-      int w2 = pointInHalfspace(a, b, p);
-
-      // determine barycentric coords
-      vec3 lambda;
-      float w = (float)(w0 + w1 + w2);
+  // Edge functions for the barycentric coordinates of a, b and c. They sum up
+  // to twice the (signed) triangle area everywhere; only triangles with a
+  // positive area have any pixels inside all three edges.
+  const EdgeFunction e0(b, c);
+  const EdgeFunction e1(c, a);
+  const EdgeFunction e2(a, b);
 
-      lambda.x = (float)w0 / w;
-      lambda.y = (float)w1 / w;
-      lambda.z = (float)w2 / w;
+  const int area = e0.evaluate(a.x, a.y);
+  if (area <= 0)
+    return;
 
-      // calculate depth here
-      float z =
-          lambda.x * posA_win.z + lambda.y * posB_win.z + lambda.z * posC_win.z;
+  TriangleSetup setup;
+  setup.stepX[0] = e0.stepX;
+  setup.stepX[1] = e1.stepX;
+  setup.stepX[2] = e2.stepX;
+  setup.bias[0] = e0.bias;
+  setup.bias[1] = e1.bias;
+  setup.bias[2] = e2.bias;
+  setup.invArea = 1.f / (float)area;
+  setup.depth[0] = posA_win.z;
+  setup.depth[1] = posB_win.z;
+  setup.depth[2] = posC_win.z;
+
+  // Attributes are interpolated linearly in screen space, so their
+  // derivatives are the same everywhere in the triangle. For the texture
+  // coordinates, they are exactly what differencing neighbouring pixels of a
+  // 2x2 quad would give.
+  const vec2 texcoordDx = (va.texcoord * (float)e0.stepX +
+                           vb.texcoord * (float)e1.stepX +
+                           vc.texcoord * (float)e2.stepX) *
+                          setup.invArea;
+  const vec2 texcoordDy = (va.texcoord * (float)e0.stepY +
+                           vb.texcoord * (float)e1.stepY +
+                           vc.texcoord * (float)e2.stepY) *
+                          setup.invArea;
+
+  // The hierarchical depth test rejects the whole triangle if it is behind
+  // everything in its bounding box.
+  Depthbuffer *depthbuffer = renderConfig.hierarchicalDepthTest
+                                 ? renderConfig.depthbuffer.get()
+                                 : nullptr;
+  const float minDepth = glm::min(posA_win.z, glm::min(posB_win.z, posC_win.z));
+  const float maxDepth = glm::max(posA_win.z, glm::max(posB_win.z, posC_win.z));
+  if (depthbuffer &&
+      !depthbuffer->isAnyVisible(min, max, minDepth - DEPTH_EPSILON))
+    return;
 
-      if (w0 >= 0 && w1 >= 0 && w2 >= 0) {
-        ShadingGeometry sgeo = t.rasterize(lambda);
-        sgeo.windowCoord = p;
-        sgeo.depth = z;
+  const CoverageKernel coverage =
+      selectCoverageKernel(renderConfig.coverageKernel);
+  SpanCoverage span;
+  int rasterized = 0, shaded = 0;
+  ShadingGeometry fragmentGeometry[SPAN_WIDTH];
+  Fragment fragments[SPAN_WIDTH];
+
+  // Rasterize -- walk the screen-space bounding box in blocks of
+  // BLOCK_SIZE x BLOCK_SIZE pixels.
+  for (int by = min.y / BLOCK_SIZE * BLOCK_SIZE; by <= max.y;
+       by += BLOCK_SIZE) {
+    for (int bx = min.x / BLOCK_SIZE * BLOCK_SIZE; bx <= max.x;
+         bx += BLOCK_SIZE) {
+      const ivec2 blockMin = glm::max(ivec2(bx, by), min);
+      const ivec2 blockMax = glm::min(ivec2(bx, by) + BLOCK_SIZE - 1, max);
+      const int spanWidth = blockMax.x - blockMin.x + 1;
+
+      // Edge functions are linear, so testing the block corners tells us
+      // whether the block is completely outside of an edge or completely
+      // inside of all three of them.
+      const EdgeFunction *edges[3] = {&e0, &e1, &e2};
+      int corners[3][4];
+      bool rejected = false;
+      bool covered = true;
+      for (int i = 0; i < 3; ++i) {
+        int *c = corners[i];
+        c[0] = edges[i]->evaluate(blockMin.x, blockMin.y);
+        c[1] = edges[i]->evaluate(blockMax.x, blockMin.y);
+        c[2] = edges[i]->evaluate(blockMin.x, blockMax.y);
+        c[3] = edges[i]->evaluate(blockMax.x, blockMax.y);
+
+        const EdgeFunction &e = *edges[i];
+        if (!e.isInside(c[0]) && !e.isInside(c[1]) && !e.isInside(c[2]) &&
+            !e.isInside(c[3])) {
+          rejected = true;
+          break;
+        }
+        if (!e.isInside(c[0]) || !e.isInside(c[1]) || !e.isInside(c[2]) ||
+            !e.isInside(c[3])) {
+          covered = false;
+        }
+      }
 
-        drawFragment(renderConfig, sgeo);
+      if (rejected)
+        continue;
+
+      // Depth is linear as well. The nearest depth of the triangle within the
+      // block is behind the farthest one stored in the tile -- nothing to see.
+      // The other way round, everything passes the depth test -- or, when
+      // testing for equal depth, nothing does. Double precision, as the
+      // corners may be far outside of the triangle.
+      bool depthPasses = false;
+      if (depthbuffer) {
+        double nearest = DBL_MAX, farthest = -DBL_MAX;
+        for (int i = 0; i < 4; ++i) {
+          const double z = ((double)corners[0][i] * posA_win.z +
+                            (double)corners[1][i] * posB_win.z +
+                            (double)corners[2][i] * posC_win.z) /
+                           area;
+          nearest = std::min(nearest, z);
+          farthest = std::max(farthest, z);
+        }
+
+        const float blockNearest = glm::max((float)nearest, minDepth);
+        const float blockFarthest = glm::min((float)farthest, maxDepth);
+        if (blockNearest - DEPTH_EPSILON >=
+            depthbuffer->getTileMax(blockMin.x, blockMin.y))
+          continue;
+        depthPasses = blockFarthest + DEPTH_EPSILON <
+                      depthbuffer->getTileMin(blockMin.x, blockMin.y);
+        if (depthPasses && depthEqual)
+          continue;
       }
+      bool written = false;
+
+      int row[3] = {e0.evaluate(blockMin.x, blockMin.y),
+                    e1.evaluate(blockMin.x, blockMin.y),
+                    e2.evaluate(blockMin.x, blockMin.y)};
+
+      for (int y = blockMin.y; y <= blockMax.y; ++y) {
+        coverage(setup, row, spanWidth, span);
+        unsigned int mask = covered ? (1u << spanWidth) - 1 : span.mask;
+        rasterized += __builtin_popcount(mask);
+
+        // Early depth test of the whole span before interpolating any
+        // attributes.
+        if (mask && renderConfig.depthbuffer && !depthOnly && !depthEqual &&
+            !depthPasses)
+          mask &= renderConfig.depthbuffer->getVisibleMask(
+              blockMin.x, y, span.depth, spanWidth);
+
+        // Interpolate the pixels that survive the early depth test and shade
+        // them in a single batch.
+        unsigned int visible = 0;
+        for (int i = 0; i < spanWidth; ++i) {
+          if (!(mask & (1u << i)))
+            continue;
+
+          const ivec2 p(blockMin.x + i, y);
+
+          // No need for shading, write to depth buffer and that's it.
+          if (depthOnly) {
+            written |= renderConfig.depthbuffer->conditionalPlot(p.x, p.y,
+                                                                 span.depth[i]);
+            continue;
+          }
+
+          if (depthEqual &&
+              !renderConfig.depthbuffer->isEqual(p.x, p.y, span.depth[i]))
+            continue;
+
+          const vec3 lambda(span.lambda0[i], span.lambda1[i], span.lambda2[i]);
+
+          fragmentGeometry[i] = interpolate(va, vb, vc, lambda);
+          fragmentGeometry[i].windowCoord = p;
+          fragmentGeometry[i].depth = span.depth[i];
+          fragmentGeometry[i].texcoordDx = texcoordDx;
+          fragmentGeometry[i].texcoordDy = texcoordDy;
+          visible |= 1u << i;
+        }
+
+        // Deferred shading -- store the fragments for later.
+        if (visible && renderConfig.gbuffer) {
+          written = !depthEqual;
+          for (int i = 0; i < spanWidth; ++i) {
+            if (!(visible & (1u << i)))
+              continue;
+            if (renderConfig.depthbuffer && !depthEqual)
+              renderConfig.depthbuffer->plot(fragmentGeometry[i].windowCoord,
+                                             fragmentGeometry[i].depth);
+            renderConfig.gbuffer->write(fragmentGeometry[i]);
+          }
+        } else if (visible) {
+          written = !depthEqual;
+          shaded += __builtin_popcount(visible);
+          renderConfig.fragmentShader->shadeBatch(fragmentGeometry, fragments,
+                                                  spanWidth, visible);
+
+          for (int i = 0; i < spanWidth; ++i) {
+            if (visible & (1u << i))
+              writeFragment(renderConfig, fragmentGeometry[i], fragments[i]);
+          }
+        }
+
+        row[0] += e0.stepY;
+        row[1] += e1.stepY;
+        row[2] += e2.stepY;
+      }
+
+      // Writes only widen the tile bounds; narrow them down again.
+      if (depthbuffer && written)
+        depthbuffer->updateTile(blockMin.x, blockMin.y);
     }
   }
+
+  debugInfo.fragmentsRasterized += rasterized;
+  debugInfo.fragmentsShaded += shaded;
 }
+
 void Rasterizer::drawFragment(const render::RenderConfig &renderConfig,
                               const ShadingGeometry &geometry) const {
+  ++debugInfo.fragmentsRasterized;
+
   // No need for shading, write to depth buffer and that's it.
-  if (!renderConfig.framebuffer) {
+  if ((!renderConfig.framebuffer && !renderConfig.gbuffer) ||
+      renderConfig.depthPass == DepthPass::DEPTH_ONLY) {
     renderConfig.depthbuffer->conditionalPlot(
         geometry.windowCoord.x, geometry.windowCoord.y, geometry.depth);
   } else {
-    if (!renderConfig.depthbuffer ||
-        (renderConfig.depthbuffer &&
-         renderConfig.depthbuffer->isVisible(geometry.windowCoord,
-                                             geometry.depth))) {
-
+    bool visible;
+    if (renderConfig.depthPass == DepthPass::SHADE_VISIBLE)
+      visible = renderConfig.depthbuffer->isEqual(
+          geometry.windowCoord.x, geometry.windowCoord.y, geometry.depth);
+    else
+      visible = !renderConfig.depthbuffer ||
+                renderConfig.depthbuffer->isVisible(geometry.windowCoord,
+                                                    geometry.depth);
+
+    if (visible && renderConfig.gbuffer) {
+      if (renderConfig.depthbuffer &&
+          renderConfig.depthPass != DepthPass::SHADE_VISIBLE)
+        renderConfig.depthbuffer->plot(geometry.windowCoord, geometry.depth);
+      renderConfig.gbuffer->write(geometry);
+    } else if (visible) {
+      ++debugInfo.fragmentsShaded;
       Fragment frag = renderConfig.fragmentShader->shadeSingle(geometry);
+      writeFragment(renderConfig, geometry, frag);
+    }
+  }
+}
+
+void Rasterizer::writeFragment(const RenderConfig &renderConfig,
+                               const ShadingGeometry &geometry,
+                               const Fragment &frag) const {
+  // Fragment was discarded by the frag shader -- ignore and
+  // keep rasterizing.
+  if (frag.discard) {
+    return;
+  } else {
+    // Fragment is valid -- write depth now, unless it is known to be there
+    // already.
+    if (renderConfig.depthbuffer &&
+        renderConfig.depthPass != DepthPass::SHADE_VISIBLE)
+      renderConfig.depthbuffer->plot(geometry.windowCoord, geometry.depth);
+  }
 
-      // Fragment was discarded by the frag shader -- ignore and
-      // keep rasterizing.
-      if (frag.discard) {
-        return;
-      } else {
-        // Fragment is valid -- write depth now.
-        if (renderConfig.depthbuffer)
-          renderConfig.depthbuffer->plot(geometry.windowCoord, geometry.depth);
+  writeColor(renderConfig, geometry.windowCoord, frag.color);
+}
+
+void Rasterizer::writeColor(const RenderConfig &renderConfig,
+                            const glm::ivec2 &p, const glm::vec4 &c) const {
+  // If we have enabled alpha blending and have a transparent
+  // fragment.
+  if (renderConfig.alphaBlending && c.a < 1) {
+    glm::vec4 color =
+        renderConfig.framebuffer->getPixel(p) * (1.f - c.a) + c * c.a;
+    renderConfig.framebuffer->plot(p, color);
+  } else {
+    renderConfig.framebuffer->plot(p, c);
+  }
+}
+
+// Number of G-buffer pixels handed to the fragment shader at once; the most a
+// batch may hold.
+static const int SHADING_BATCH = 32;
+
+void Rasterizer::shadeGBuffer(const RenderConfig &renderConfig) const {
+  if (!renderConfig.isValid() || !renderConfig.framebuffer ||
+      !renderConfig.gbuffer) {
+    std::cerr << "Invalid render configuration!\n";
+    return;
+  }
+
+  const Viewport &viewport = *renderConfig.viewport;
+  const GBuffer &gbuffer = *renderConfig.gbuffer;
+
+  // Walks a row of the viewport in batches of pixels and shades the covered
+  // ones with a single call per batch.
+  auto shadeRow = [&](int y) {
+    ShadingGeometry fragmentGeometry[SHADING_BATCH];
+    Fragment fragments[SHADING_BATCH];
+    int shaded = 0;
+
+    const int end = viewport.origin.x + viewport.size.x;
+    for (int x = viewport.origin.x; x < end; x += SHADING_BATCH) {
+      const int batchSize = std::min(SHADING_BATCH, end - x);
+
+      unsigned int covered = 0;
+      for (int i = 0; i < batchSize; ++i) {
+        if (gbuffer.isCovered(x + i, y)) {
+          fragmentGeometry[i] = gbuffer.read(x + i, y);
+          covered |= 1u << i;
+        }
+      }
+      if (!covered)
+        continue;
+
+      shaded += __builtin_popcount(covered);
+      renderConfig.fragmentShader->shadeBatch(fragmentGeometry, fragments,
+                                              batchSize, covered);
+
+      for (int i = 0; i < batchSize; ++i) {
+        if ((covered & (1u << i)) && !fragments[i].discard)
+          writeColor(renderConfig, fragmentGeometry[i].windowCoord,
+                     fragments[i].color);
       }
+    }
 
-      // If we have enabled alpha blending and have a transparent
-      // fragment.
-      if (renderConfig.alphaBlending && frag.color.a < 1) {
-        glm::vec4 color =
-            renderConfig.framebuffer->getPixel(geometry.windowCoord) *
-                (1.f - frag.color.a) +
-            frag.color * frag.color.a;
-        renderConfig.framebuffer->plot(geometry.windowCoord, color);
-      } else {
-        renderConfig.framebuffer->plot(geometry.windowCoord, frag.color);
+    debugInfo.fragmentsShaded += shaded;
+  };
+
+  // Rows are independent of each other, so they can be shaded in parallel --
+  // in bands of whole framebuffer tiles, which are cleared as a unit.
+  if (renderConfig.tiledRasterization) {
+    const int firstBand = viewport.origin.y / Framebuffer::TILE_SIZE;
+    const int lastBand =
+        (viewport.origin.y + viewport.size.y - 1) / Framebuffer::TILE_SIZE;
+    getWorkers().parallelFor(lastBand - firstBand + 1, [&](size_t band) {
+      const int y0 = std::max(
+          (firstBand + (int)band) * Framebuffer::TILE_SIZE, viewport.origin.y);
+      const int y1 =
+          std::min((firstBand + (int)band + 1) * Framebuffer::TILE_SIZE,
+                   viewport.origin.y + viewport.size.y);
+      for (int y = y0; y < y1; ++y) {
+        shadeRow(y);
       }
+    });
+  } else {
+    for (int y = 0; y < viewport.size.y; ++y) {
+      shadeRow(viewport.origin.y + y);
     }
   }
-}
\ No newline at end of file
+}
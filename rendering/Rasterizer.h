@@ -2,17 +2,25 @@
 #define RASTERISER_INCLUDED
 
 #include <memory>
+#include <thread>
 
 #include "Clipper.h"
 #include "Pipeline.h"
 #include "RenderConfig.h"
 #include "RenderDebugInfo.h"
+#include "VertexBuffer.h"
+#include "WorkerPool.h"
 
 namespace render {
 // Main class that does the heavy lifting in putting fragments into the
 // framebuffer.
 class Rasterizer {
 public:
+  // The thread count is only used for tiled rasterization and threaded vertex
+  // processing; see RenderConfig.
+  explicit Rasterizer(
+      unsigned int threadCount = std::thread::hardware_concurrency());
+
   virtual ~Rasterizer() = default;
 
   // Draws the vertices as points. Only the indexed vertices are drawn.
@@ -40,21 +48,98 @@ public:
                              const VertexList &vertices,
                              const IndexList &indices) const;
 
+  // Same as above, for buffers that are kept between frames. The transformed
+  // vertices are cached in the vertex buffer; while the vertex shader state
+  // stays the same, only vertices that changed since the last draw are
+  // transformed again. As this writes to the buffer, a buffer may only be
+  // drawn by one thread at a time; see VertexBuffer.
+  void drawLines(const RenderConfig &renderConfig,
+                 const VertexBuffer &vertices,
+                 const IndexBuffer &indices) const;
+
+  void drawTriangles(const RenderConfig &renderConfig,
+                     const VertexBuffer &vertices,
+                     const IndexBuffer &indices) const;
+
+  // The shading pass of deferred shading: runs the fragment shader over all
+  // pixels of the G-buffer within the viewport that were covered since it was
+  // last cleared, and writes the results to the framebuffer. Requires both of
+  // them to be set. With tiled rasterization enabled, rows are shaded on the
+  // worker threads.
+  void shadeGBuffer(const RenderConfig &renderConfig) const;
+
   inline void resetDebugInfo() { debugInfo.reset(); }
 
+  inline const DebugInfo &getDebugInfo() const { return debugInfo; }
+
 private:
   // Draws a line after it was clipped to the Viewport.
   void drawLine(const RenderConfig &renderConfig,
                 const LinePrimitive &line) const;
 
-  // Draws a triangle that was clipped to the viewport.
-  void drawTriangle(const RenderConfig &renderConfig,
-                    const TrianglePrimitive &t) const;
+  // The vertices the triangles of a draw refer to: the transformed vertices,
+  // followed by the corners that clipping created.
+  struct TriangleVertices {
+    const VertexOutList &transformed;
+    const VertexOutList &clipped;
+
+    inline const VertexOut &operator[](unsigned int i) const {
+      return i < transformed.size() ? transformed[i]
+                                    : clipped[i - transformed.size()];
+    }
+  };
+
+  // Draws a triangle that was clipped to the viewport, given by its corners
+  // in clip space. Only pixels within the inclusive window-space rectangle
+  // [clipMin, clipMax] are touched.
+  void drawTriangle(const RenderConfig &renderConfig, const VertexOut &a,
+                    const VertexOut &b, const VertexOut &c,
+                    const glm::ivec2 &clipMin,
+                    const glm::ivec2 &clipMax) const;
+
+  // Sorts the clipped triangles into screen tiles and rasterizes the tiles in
+  // parallel. Triangles keep their submission order within a tile.
+  void drawTrianglesTiled(const RenderConfig &renderConfig,
+                          const TriangleVertices &vertices,
+                          const IndexedTriangleList &triangles) const;
+
+  // Clips, assembles and draws lines from transformed vertices.
+  void drawTransformedLines(const RenderConfig &renderConfig,
+                            const VertexOutList &vertices,
+                            const IndexList &indices) const;
+
+  // Clips, assembles and draws triangles from transformed vertices.
+  void drawTransformedTriangles(const RenderConfig &renderConfig,
+                                const VertexOutList &vertices,
+                                const IndexList &indices) const;
 
   // Vertex transform of the input vertices
-  VertexOutList
-  transformVertices(const VertexList &verticesIn,
-                    std::shared_ptr<VertexShader> vertexShader) const;
+  VertexOutList transformVertices(const RenderConfig &renderConfig,
+                                  const VertexList &verticesIn) const;
+
+  // Transforms count vertices from in to out, spreading them over the worker
+  // threads if enabled.
+  void transformVertices(const RenderConfig &renderConfig, const Vertex *in,
+                         VertexOut *out, size_t count) const;
+
+  // Brings the transformed vertices cached in a vertex buffer up to date and
+  // returns them.
+  const VertexOutList &transformVertexBuffer(const RenderConfig &renderConfig,
+                                             const VertexBuffer &buffer) const;
+
+  // Index-driven vertex transform with a post-transform cache: only the
+  // vertices referenced by indices are transformed, each of them exactly once.
+  // Returns the indices into the transformed vertices, which is either indices
+  // itself or remappedIndices. If an index is out of range, nothing is
+  // transformed and the returned list is empty.
+  const IndexList &transformIndexedVertices(const RenderConfig &renderConfig,
+                                            const VertexList &vertices,
+                                            const IndexList &indices,
+                                            VertexOutList &transformed,
+                                            IndexList &remappedIndices) const;
+
+  // Returns the worker threads, starting them on first use.
+  WorkerPool &getWorkers() const;
 
   // Rasterizes a single fragment to the buffer after performing depth test and
   // alpha blending. This is called from both the drawTriangle and drawLine
@@ -62,8 +147,29 @@ private:
   void drawFragment(const RenderConfig &renderConfig,
                     const ShadingGeometry &geometry) const;
 
+  // Writes an already shaded fragment that passed the depth test: updates the
+  // depth buffer and writes or blends the color. Discarded fragments are
+  // ignored.
+  void writeFragment(const RenderConfig &renderConfig,
+                     const ShadingGeometry &geometry,
+                     const Fragment &frag) const;
+
+  // Writes or blends a color into the framebuffer.
+  void writeColor(const RenderConfig &renderConfig, const glm::ivec2 &p,
+                  const glm::vec4 &c) const;
+
   Clipper             clipper;
   mutable DebugInfo   debugInfo;
+
+  // Kept between draws so that triangle clipping does not allocate once they
+  // have grown large enough: the outcodes of the transformed vertices and the
+  // corners of the clipped triangles.
+  mutable std::vector<unsigned short> outcodes;
+  mutable VertexOutList               clippedVertices;
+
+  // Created on first use; see getWorkers().
+  unsigned int                        threadCount;
+  mutable std::unique_ptr<WorkerPool> workers;
 };
 
 } // namespace render
@@ -0,0 +1,129 @@
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Depthbuffer.h"
+#include "Framebuffer.h"
+#include "Rasterizer.h"
+#include "Shader.h"
+#include "Viewport.h"
+
+using namespace render;
+using glm::vec2;
+using glm::vec3;
+using glm::vec4;
+
+// Compares the frame and depth buffer layouts. Renders the same scenes with
+// row by row and with tiled buffers and prints the time per frame. The
+// library is built without optimizations by default; the numbers only mean
+// something with optimizations turned on.
+//
+// Usage: gfx93-rendering-benchmark [frames]
+
+static const unsigned int WIDTH = 1920;
+static const unsigned int HEIGHT = 1080;
+
+// Tall, narrow triangles: every row of their bounding box is a new cache line
+// with the linear layout.
+static void makeTallTriangles(VertexList &vertices, IndexList &indices) {
+  std::mt19937 rng(1993);
+  std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+  for (int i = 0; i < 500; ++i) {
+    const float x = unit(rng) * 2.f - 1.f;
+    const float width = 0.002f + unit(rng) * 0.01f;
+    const float z = unit(rng) * 1.8f - 0.9f;
+    const vec4 color(unit(rng), unit(rng), unit(rng), 1.f);
+
+    const vec4 corners[3] = {vec4(x, -1.f, z, 1.f),
+                             vec4(x + width, -1.f, z, 1.f),
+                             vec4(x + width / 2, 1.f, z, 1.f)};
+    for (const vec4 &p : corners) {
+      vertices.push_back(Vertex(p, vec3(0, 0, 1), color, vec2(0)));
+      indices.push_back(vertices.size() - 1);
+    }
+  }
+}
+
+// Overlapping triangles of all sizes and orientations.
+static void makeRandomTriangles(VertexList &vertices, IndexList &indices) {
+  std::mt19937 rng(1993);
+  std::uniform_real_distribution<float> position(-1.f, 1.f);
+  std::uniform_real_distribution<float> depth(-0.9f, 0.9f);
+  std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+  for (int i = 0; i < 200; ++i) {
+    const vec4 color(unit(rng), unit(rng), unit(rng), 1.f);
+    for (int j = 0; j < 3; ++j) {
+      vec4 p(position(rng), position(rng), depth(rng), 1.f);
+      vertices.push_back(Vertex(p, vec3(0, 0, 1), color, vec2(0)));
+      indices.push_back(vertices.size() - 1);
+    }
+  }
+}
+
+static double measure(BufferLayout layout, PixelFormat format, bool tiled,
+                      const VertexList &vertices, const IndexList &indices,
+                      int frames) {
+  RenderConfig config;
+  config.viewport = std::make_shared<Viewport>(0, 0, WIDTH, HEIGHT);
+  config.framebuffer =
+      std::make_shared<Framebuffer>(WIDTH, HEIGHT, format, layout);
+  config.depthbuffer = std::make_shared<Depthbuffer>(
+      WIDTH, HEIGHT, DepthFormat::FLOAT32, layout);
+  config.vertexShader = std::make_shared<DefaultVertexTransform>();
+  config.fragmentShader = std::make_shared<InputColorShader>();
+  config.cullMode = CullMode::NONE;
+  config.tiledRasterization = tiled;
+
+  Rasterizer rasterizer;
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < frames; ++i) {
+    config.clearBuffers(vec4(0, 0, 0, 1));
+    rasterizer.drawTriangles(config, vertices, indices);
+    config.framebuffer->getData();
+  }
+  const std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count() / frames;
+}
+
+int main(int argc, const char **argv) {
+  const int frames = argc > 1 ? std::max(std::stoi(argv[1]), 1) : 3;
+
+  struct Scene {
+    const char *name;
+    void (*make)(VertexList &, IndexList &);
+  } scenes[] = {{"tall triangles", makeTallTriangles},
+                {"random triangles", makeRandomTriangles}};
+
+  std::cout << WIDTH << "x" << HEIGHT << ", " << frames
+            << " frames, ms per frame including readback\n";
+  std::cout << std::fixed << std::setprecision(2);
+
+  for (const Scene &scene : scenes) {
+    VertexList vertices;
+    IndexList indices;
+    scene.make(vertices, indices);
+
+    for (PixelFormat format : {PixelFormat::RGBA32F, PixelFormat::RGBA8}) {
+      for (bool tiled : {false, true}) {
+        const double linear = measure(BufferLayout::LINEAR, format, tiled,
+                                      vertices, indices, frames);
+        const double tiles = measure(BufferLayout::TILED, format, tiled,
+                                     vertices, indices, frames);
+
+        std::cout << scene.name << ", "
+                  << (format == PixelFormat::RGBA8 ? "RGBA8" : "RGBA32F")
+                  << (tiled ? ", tiled rasterization" : "")
+                  << ": linear " << linear << ", tiled " << tiles << "\n";
+      }
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,1154 @@
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Depthbuffer.h"
+#include "FrameSink.h"
+#include "Framebuffer.h"
+#include "Image.h"
+#include "RasterKernel.h"
+#include "Rasterizer.h"
+#include "Shader.h"
+#include "Viewport.h"
+
+using namespace render;
+using glm::vec2;
+using glm::vec3;
+using glm::vec4;
+
+static const unsigned int WIDTH = 200;
+static const unsigned int HEIGHT = 150;
+
+RenderConfig makeRenderConfig() {
+  RenderConfig config;
+  config.viewport = std::make_shared<Viewport>(0, 0, WIDTH, HEIGHT);
+  config.framebuffer = std::make_shared<Framebuffer>(WIDTH, HEIGHT);
+  config.depthbuffer = std::make_shared<Depthbuffer>(WIDTH, HEIGHT);
+
+  // Vertices are given in clip space already.
+  config.vertexShader = std::make_shared<DefaultVertexTransform>();
+  config.fragmentShader = std::make_shared<InputColorShader>();
+
+  config.clearBuffers(vec4(0, 0, 0, 1));
+  return config;
+}
+
+// Creates a bunch of overlapping, partially transparent triangles; some of
+// them reach outside of the view volume.
+void makeRandomTriangles(VertexList &vertices, IndexList &indices) {
+  std::mt19937 rng(1993);
+  std::uniform_real_distribution<float> position(-1.5f, 1.5f);
+  std::uniform_real_distribution<float> depth(-0.9f, 0.9f);
+  std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+  for (int i = 0; i < 200; ++i) {
+    vec4 color(unit(rng), unit(rng), unit(rng), i % 3 == 0 ? 0.5f : 1.f);
+    for (int j = 0; j < 3; ++j) {
+      vec4 p(position(rng), position(rng), depth(rng), 1.f);
+      vertices.push_back(Vertex(p, vec3(0, 0, 1), color, vec2(0)));
+      indices.push_back(vertices.size() - 1);
+    }
+  }
+}
+
+void assertBuffersEqual(const RenderConfig &a, const RenderConfig &b) {
+  for (unsigned int y = 0; y < HEIGHT; ++y) {
+    for (unsigned int x = 0; x < WIDTH; ++x) {
+      assert(a.framebuffer->getPixel(x, y) == b.framebuffer->getPixel(x, y));
+      assert(a.depthbuffer->getDepth(x, y) == b.depthbuffer->getDepth(x, y));
+    }
+  }
+}
+
+int testTiledMatchesSerial(unsigned int threadCount) {
+  VertexList vertices;
+  IndexList indices;
+  makeRandomTriangles(vertices, indices);
+
+  RenderConfig serial = makeRenderConfig();
+  serial.alphaBlending = true;
+  Rasterizer().drawTriangles(serial, vertices, indices);
+
+  // Odd tile size so that tiles do not line up with the buffer edges. It gets
+  // rounded up to a multiple of the depth buffer tiles.
+  RenderConfig tiled = makeRenderConfig();
+  tiled.alphaBlending = true;
+  tiled.tiledRasterization = true;
+  tiled.tileSize = 23;
+  Rasterizer(threadCount).drawTriangles(tiled, vertices, indices);
+
+  assertBuffersEqual(serial, tiled);
+  return 0;
+}
+
+// Brute-force coverage test of a single pixel against a triangle given in
+// window coordinates. Pixels on an edge are inside if the edge function grows
+// along x, or along y for horizontal edges.
+bool isInside(const glm::ivec2 &a, const glm::ivec2 &b, const glm::ivec2 &c,
+              const glm::ivec2 &p) {
+  auto inside = [](const glm::ivec2 &u, const glm::ivec2 &v,
+                   const glm::ivec2 &q) {
+    const int e = (v.x - u.x) * (q.y - u.y) - (v.y - u.y) * (q.x - u.x);
+    const bool owned = u.y > v.y || (u.y == v.y && v.x > u.x);
+    return owned ? e >= 0 : e > 0;
+  };
+  return inside(b, c, p) && inside(c, a, p) && inside(a, b, p);
+}
+
+int testTriangleCoverage() {
+  // Long and thin, large, and tiny triangles.
+  const std::vector<std::vector<vec3>> triangles = {
+      {vec3(-0.95f, -0.9f, 0), vec3(0.95f, 0.8f, 0), vec3(0.9f, 0.85f, 0)},
+      {vec3(-0.8f, -0.8f, 0), vec3(0.9f, -0.7f, 0), vec3(0.1f, 0.9f, 0)},
+      {vec3(0.1f, 0.1f, 0), vec3(0.13f, 0.1f, 0), vec3(0.1f, 0.14f, 0)}};
+
+  for (const auto &corners : triangles) {
+    RenderConfig config = makeRenderConfig();
+    config.fragmentShader = std::make_shared<SingleColorShader>(vec4(1));
+
+    VertexList vertices;
+    for (const vec3 &p : corners) {
+      vertices.push_back(Vertex(vec4(p, 1)));
+    }
+    Rasterizer().drawTriangles(config, vertices, {0, 1, 2});
+
+    const Viewport &viewport = *config.viewport;
+    const glm::ivec2 a(viewport.calculateWindowCoordinates(corners[0]));
+    const glm::ivec2 b(viewport.calculateWindowCoordinates(corners[1]));
+    const glm::ivec2 c(viewport.calculateWindowCoordinates(corners[2]));
+
+    int drawnPixels = 0;
+    for (unsigned int y = 0; y < HEIGHT; ++y) {
+      for (unsigned int x = 0; x < WIDTH; ++x) {
+        const bool drawn = config.framebuffer->getPixel(x, y) == vec4(1);
+        assert(drawn == isInside(a, b, c, glm::ivec2(x, y)));
+        drawnPixels += drawn;
+      }
+    }
+    assert(drawnPixels > 0);
+  }
+  return 0;
+}
+
+void assertSpansEqual(const SpanCoverage &a, const SpanCoverage &b) {
+  assert(a.mask == b.mask);
+  for (int i = 0; i < SPAN_WIDTH; ++i) {
+    assert(a.lambda0[i] == b.lambda0[i]);
+    assert(a.lambda1[i] == b.lambda1[i]);
+    assert(a.lambda2[i] == b.lambda2[i]);
+    assert(a.depth[i] == b.depth[i]);
+  }
+}
+
+int testSimdKernelsMatchScalar() {
+  const CoverageKernel scalar = selectCoverageKernel(SimdKernel::SCALAR);
+
+  std::mt19937 rng(1993);
+  std::uniform_int_distribution<int> edge(-5000, 5000);
+  std::uniform_int_distribution<int> step(-300, 300);
+  std::uniform_int_distribution<int> width(0, SPAN_WIDTH);
+  std::uniform_real_distribution<float> depth(0.f, 1.f);
+
+  for (SimdKernel kernel : {SimdKernel::SSE2, SimdKernel::AVX2}) {
+    if (!isSupported(kernel))
+      continue;
+    const CoverageKernel simd = selectCoverageKernel(kernel);
+
+    // Kernels on their own.
+    for (int i = 0; i < 10000; ++i) {
+      TriangleSetup setup;
+      int w[3];
+      for (int j = 0; j < 3; ++j) {
+        setup.stepX[j] = step(rng);
+        setup.bias[j] = -(int)(rng() % 2);
+        setup.depth[j] = depth(rng);
+        w[j] = edge(rng);
+      }
+      setup.invArea = 1.f / (float)(w[0] + w[1] + w[2] + 15001);
+      const int count = width(rng);
+
+      SpanCoverage expected, actual;
+      scalar(setup, w, count, expected);
+      simd(setup, w, count, actual);
+      assertSpansEqual(expected, actual);
+    }
+
+    // And as part of the rasterizer.
+    VertexList vertices;
+    IndexList indices;
+    makeRandomTriangles(vertices, indices);
+
+    RenderConfig reference = makeRenderConfig();
+    reference.coverageKernel = SimdKernel::SCALAR;
+    Rasterizer().drawTriangles(reference, vertices, indices);
+
+    RenderConfig vectorized = makeRenderConfig();
+    vectorized.coverageKernel = kernel;
+    Rasterizer().drawTriangles(vectorized, vertices, indices);
+
+    assertBuffersEqual(reference, vectorized);
+  }
+  return 0;
+}
+
+// Only implements shadeSingle, so it goes through the default batch path.
+class SingleOnlyColorShader : public FragmentShader {
+public:
+  Fragment shadeSingle(const ShadingGeometry &in) override {
+    return Fragment{in.color};
+  }
+};
+
+int testBatchShadingMatchesSingle() {
+  VertexList vertices;
+  IndexList indices;
+  makeRandomTriangles(vertices, indices);
+
+  RenderConfig native = makeRenderConfig();
+  native.alphaBlending = true;
+  Rasterizer().drawTriangles(native, vertices, indices);
+
+  RenderConfig fallback = makeRenderConfig();
+  fallback.alphaBlending = true;
+  fallback.fragmentShader = std::make_shared<SingleOnlyColorShader>();
+  Rasterizer().drawTriangles(fallback, vertices, indices);
+
+  assertBuffersEqual(native, fallback);
+  return 0;
+}
+
+int testVertexBatchMatchesSingle() {
+  DefaultVertexTransform transform;
+  transform.modelMatrix = glm::mat4(2.f);
+  transform.modelMatrix[3] = vec4(1, -2, 3, 1);
+  transform.viewMatrix = glm::mat4(1.f);
+  transform.viewMatrix[3] = vec4(0, 0, -10, 1);
+  transform.projectionMatrix = glm::mat4(1.f);
+  transform.projectionMatrix[2][3] = -1.f;
+
+  VertexList vertices;
+  IndexList indices;
+  makeRandomTriangles(vertices, indices);
+  // Something that does not line up with the vector width.
+  vertices.pop_back();
+
+  VertexOutList batch(vertices.size());
+  transform.transformBatch(vertices.data(), batch.data(), vertices.size());
+
+  for (size_t i = 0; i < vertices.size(); ++i) {
+    const VertexOut single = transform.transformSingle(vertices[i]);
+    assert(glm::length(single.clipPosition - batch[i].clipPosition) < 1e-4f);
+    assert(glm::length(single.worldPosition - batch[i].worldPosition) < 1e-4f);
+    assert(single.worldNormal == batch[i].worldNormal);
+    assert(single.color == batch[i].color);
+    assert(single.texcoord == batch[i].texcoord);
+  }
+  return 0;
+}
+
+int testThreadedVertexProcessing() {
+  VertexList vertices;
+  IndexList indices;
+  for (int i = 0; i < 40; ++i) {
+    makeRandomTriangles(vertices, indices);
+  }
+
+  RenderConfig serial = makeRenderConfig();
+  Rasterizer().drawTriangles(serial, vertices, indices);
+
+  RenderConfig threaded = makeRenderConfig();
+  threaded.threadedVertexProcessing = true;
+  Rasterizer(4).drawTriangles(threaded, vertices, indices);
+
+  assertBuffersEqual(serial, threaded);
+  return 0;
+}
+
+// Counts how many vertices it has transformed. Its output only depends on the
+// matrices, so it can be cached.
+class CountingVertexTransform : public DefaultVertexTransform {
+public:
+  size_t transformedVertices = 0;
+
+  bool isTransformCacheable() const override { return true; }
+
+  void transformBatch(const Vertex *in, VertexOut *out,
+                      size_t count) override {
+    transformedVertices += count;
+    DefaultVertexTransform::transformBatch(in, out, count);
+  }
+};
+
+int testVertexCacheSkipsUnusedVertices() {
+  VertexList vertices;
+  IndexList indices;
+  makeRandomTriangles(vertices, indices);
+
+  // Every third triangle is dropped, and the remaining ones are drawn twice.
+  IndexList sparseIndices;
+  for (int pass = 0; pass < 2; ++pass) {
+    for (size_t i = 0; i < indices.size(); i += 3) {
+      if ((i / 3) % 3 != 0) {
+        sparseIndices.insert(sparseIndices.end(), indices.begin() + i,
+                             indices.begin() + i + 3);
+      }
+    }
+  }
+
+  // The same triangles without any unused vertices.
+  VertexList denseVertices;
+  IndexList denseIndices;
+  for (unsigned int index : sparseIndices) {
+    denseVertices.push_back(vertices[index]);
+    denseIndices.push_back(denseVertices.size() - 1);
+  }
+
+  auto counter = std::make_shared<CountingVertexTransform>();
+  RenderConfig cached = makeRenderConfig();
+  cached.vertexShader = counter;
+  Rasterizer().drawTriangles(cached, vertices, sparseIndices);
+
+  RenderConfig dense = makeRenderConfig();
+  Rasterizer().drawTriangles(dense, denseVertices, denseIndices);
+
+  assert(counter->transformedVertices == sparseIndices.size() / 2);
+  assertBuffersEqual(cached, dense);
+
+  // An index past the end draws nothing instead of reading out of bounds.
+  sparseIndices.back() = vertices.size();
+  counter->transformedVertices = 0;
+  Rasterizer().drawTriangles(cached, vertices, sparseIndices);
+  assert(counter->transformedVertices == 0);
+  return 0;
+}
+
+// Draws the buffers with the given vertex shader and checks the result against
+// drawing the plain lists.
+void assertBufferDrawMatchesLists(const std::shared_ptr<VertexShader> &shader,
+                                  const VertexBuffer &vertices,
+                                  const IndexBuffer &indices) {
+  RenderConfig buffered = makeRenderConfig();
+  buffered.vertexShader = shader;
+  Rasterizer().drawTriangles(buffered, vertices, indices);
+
+  RenderConfig lists = makeRenderConfig();
+  lists.vertexShader = shader;
+  Rasterizer().drawTriangles(lists, vertices.getVertices(),
+                             indices.getIndices());
+
+  assertBuffersEqual(buffered, lists);
+}
+
+int testVertexBufferCachesTransform() {
+  VertexList vertexList;
+  IndexList indexList;
+  makeRandomTriangles(vertexList, indexList);
+
+  VertexBuffer vertices(vertexList);
+  IndexBuffer indices(indexList);
+  assert(indices.getRequiredVertexCount() == vertices.size());
+
+  auto counter = std::make_shared<CountingVertexTransform>();
+  RenderConfig config = makeRenderConfig();
+  config.vertexShader = counter;
+
+  // The first draw transforms everything, the second one nothing.
+  Rasterizer().drawTriangles(config, vertices, indices);
+  assert(counter->transformedVertices == vertices.size());
+  Rasterizer().drawTriangles(config, vertices, indices);
+  assert(counter->transformedVertices == vertices.size());
+
+  // Appending only transforms the new vertices.
+  counter->transformedVertices = 0;
+  const vec4 red(1, 0, 0, 1);
+  vertices.push_back(Vertex(vec4(-0.5f, -0.5f, 0, 1), vec3(0), red, vec2(0)));
+  vertices.push_back(Vertex(vec4(0.5f, -0.5f, 0, 1), vec3(0), red, vec2(0)));
+  vertices.push_back(Vertex(vec4(0, 0.5f, 0, 1), vec3(0), red, vec2(0)));
+  for (unsigned int i = 3; i > 0; --i)
+    indices.push_back(vertices.size() - i);
+
+  RenderConfig appended = makeRenderConfig();
+  appended.vertexShader = counter;
+  Rasterizer().drawTriangles(appended, vertices, indices);
+  assert(counter->transformedVertices == 3);
+
+  // Writing to a vertex only transforms that one.
+  counter->transformedVertices = 0;
+  vertices[10].color = red;
+  Rasterizer().drawTriangles(appended, vertices, indices);
+  assert(counter->transformedVertices == 1);
+
+  // A new transform invalidates all of them.
+  counter->transformedVertices = 0;
+  counter->modelMatrix[0][0] = 0.5f;
+  Rasterizer().drawTriangles(appended, vertices, indices);
+  assert(counter->transformedVertices == vertices.size());
+
+  // And the cached vertices still give the same picture as the lists.
+  assertBufferDrawMatchesLists(counter, vertices, indices);
+
+  vec3 boundsMin = vec3(vertices[0].position);
+  vec3 boundsMax = boundsMin;
+  for (const Vertex &v : vertices) {
+    boundsMin = glm::min(boundsMin, vec3(v.position));
+    boundsMax = glm::max(boundsMax, vec3(v.position));
+  }
+  assert(vertices.getBoundsMin() == boundsMin);
+  assert(vertices.getBoundsMax() == boundsMax);
+
+  // Another shader with the same matrices does not reuse the vertices.
+  auto other = std::make_shared<CountingVertexTransform>();
+  other->modelMatrix = counter->modelMatrix;
+  other->viewMatrix = counter->viewMatrix;
+  other->projectionMatrix = counter->projectionMatrix;
+  RenderConfig otherConfig = makeRenderConfig();
+  otherConfig.vertexShader = other;
+  Rasterizer().drawTriangles(otherConfig, vertices, indices);
+  assert(other->transformedVertices == vertices.size());
+  return 0;
+}
+
+// Moves all vertices by an offset that is not part of the matrices, without
+// opting in to caching.
+class OffsetVertexTransform : public DefaultVertexTransform {
+public:
+  vec4 offset = vec4(0.f);
+
+  VertexOut transformSingle(const Vertex &in) override {
+    VertexOut out = DefaultVertexTransform::transformSingle(in);
+    out.clipPosition += offset;
+    return out;
+  }
+
+  void transformBatch(const Vertex *in, VertexOut *out,
+                      size_t count) override {
+    DefaultVertexTransform::transformBatch(in, out, count);
+    for (size_t i = 0; i < count; ++i)
+      out[i].clipPosition += offset;
+  }
+};
+
+int testVertexBufferDerivedShader() {
+  VertexList vertexList;
+  IndexList indexList;
+  makeRandomTriangles(vertexList, indexList);
+  const VertexBuffer vertices(vertexList);
+  const IndexBuffer indices(indexList);
+
+  // Subclasses inherit the matrices, but not the permission to cache.
+  auto shader = std::make_shared<OffsetVertexTransform>();
+  assert(!shader->isTransformCacheable());
+  assert(std::make_shared<DefaultVertexTransform>()->isTransformCacheable());
+
+  assertBufferDrawMatchesLists(shader, vertices, indices);
+  shader->offset = vec4(0.3f, -0.2f, 0, 0);
+  assertBufferDrawMatchesLists(shader, vertices, indices);
+  return 0;
+}
+
+int testFaceCulling() {
+  const vec4 red(1, 0, 0, 1), green(0, 1, 0, 1);
+  VertexList vertices;
+  // Counter-clockwise on the left, clockwise on the right.
+  vertices.push_back(Vertex(vec4(-0.9f, -0.5f, 0, 1), vec3(0), red, vec2(0)));
+  vertices.push_back(Vertex(vec4(-0.1f, -0.5f, 0, 1), vec3(0), red, vec2(0)));
+  vertices.push_back(Vertex(vec4(-0.5f, 0.5f, 0, 1), vec3(0), red, vec2(0)));
+  vertices.push_back(Vertex(vec4(0.1f, -0.5f, 0, 1), vec3(0), green, vec2(0)));
+  vertices.push_back(Vertex(vec4(0.5f, 0.5f, 0, 1), vec3(0), green, vec2(0)));
+  vertices.push_back(Vertex(vec4(0.9f, -0.5f, 0, 1), vec3(0), green, vec2(0)));
+  // Clockwise again, reaching behind the near plane.
+  vertices.push_back(Vertex(vec4(-0.5f, 0, -2, 1), vec3(0), green, vec2(0)));
+  vertices.push_back(Vertex(vec4(0, 0.5f, 0.5f, 1), vec3(0), green, vec2(0)));
+  vertices.push_back(Vertex(vec4(0.5f, 0, 0.5f, 1), vec3(0), green, vec2(0)));
+  const IndexList indices = {0, 1, 2, 3, 4, 5, 6, 7, 8};
+
+  const glm::ivec2 left(WIDTH / 4, HEIGHT / 2);
+  const glm::ivec2 right(WIDTH * 3 / 4, HEIGHT / 2);
+  const vec4 black(0, 0, 0, 1);
+
+  struct {
+    CullMode mode;
+    vec4 left, right;
+    int culled, clipped;
+  } cases[] = {{CullMode::BACK, red, black, 2, 0},
+               {CullMode::FRONT, black, green, 1, 1},
+               {CullMode::NONE, red, green, 0, 1}};
+
+  for (const auto &c : cases) {
+    RenderConfig config = makeRenderConfig();
+    config.cullMode = c.mode;
+    Rasterizer rasterizer;
+    rasterizer.drawTriangles(config, vertices, indices);
+
+    assert(config.framebuffer->getPixel(left.x, left.y) == c.left);
+    assert(config.framebuffer->getPixel(right.x, right.y) == c.right);
+    assert(rasterizer.getDebugInfo().trianglesCulled == c.culled);
+    assert(rasterizer.getDebugInfo().trianglesClipped == c.clipped);
+  }
+  return 0;
+}
+
+int testGuardBandClipping() {
+  const vec4 red(1, 0, 0, 1);
+
+  // Both triangles cover the whole viewport; the second one reaches beyond
+  // the guard band.
+  for (float extent : {5.f, 1e5f}) {
+    VertexList vertices;
+    vertices.push_back(Vertex(vec4(-3, -3, 0, 1), vec3(0), red, vec2(0)));
+    vertices.push_back(Vertex(vec4(extent, -3, 0, 1), vec3(0), red, vec2(0)));
+    vertices.push_back(Vertex(vec4(-3, extent, 0, 1), vec3(0), red, vec2(0)));
+    const IndexList indices = {0, 1, 2};
+
+    for (bool guardBand : {true, false}) {
+      RenderConfig config = makeRenderConfig();
+      config.guardBandClipping = guardBand;
+      Rasterizer rasterizer;
+      rasterizer.drawTriangles(config, vertices, indices);
+
+      // Clipped triangles interpolate the color, so allow for rounding.
+      for (unsigned int y = 0; y < HEIGHT; ++y) {
+        for (unsigned int x = 0; x < WIDTH; ++x)
+          assert(glm::length(config.framebuffer->getPixel(x, y) - red) <
+                 1e-5f);
+      }
+
+      const bool needsClipping = !guardBand || extent > 1000.f;
+      assert(rasterizer.getDebugInfo().trianglesClipped == needsClipping);
+    }
+  }
+  return 0;
+}
+
+int testHierarchicalDepthBounds() {
+  Depthbuffer depth(20, 12);
+  depth.clear();
+  assert(!depth.isAnyVisible(glm::ivec2(0), glm::ivec2(19, 11), FLT_MAX));
+
+  // Writes widen the bounds of their tile only.
+  depth.plot(9, 3, 0.5f);
+  depth.plot(10, 4, 0.25f);
+  assert(depth.getTileMin(8, 0) == 0.25f);
+  assert(depth.getTileMax(15, 7) == FLT_MAX);
+  assert(depth.getTileMin(0, 0) == FLT_MAX);
+
+  // Fill the tile, then narrow its bounds down.
+  for (int y = 0; y < 8; ++y) {
+    for (int x = 8; x < 16; ++x)
+      depth.conditionalPlot(x, y, 0.75f);
+  }
+  assert(depth.getTileMax(8, 0) == FLT_MAX);
+  depth.updateTile(13, 2);
+  assert(depth.getTileMin(8, 0) == 0.25f);
+  assert(depth.getTileMax(8, 0) == 0.75f);
+
+  assert(!depth.isAnyVisible(glm::ivec2(8, 0), glm::ivec2(15, 7), 0.8f));
+  assert(depth.isAnyVisible(glm::ivec2(8, 0), glm::ivec2(15, 7), 0.7f));
+  assert(depth.isAnyVisible(glm::ivec2(8, 0), glm::ivec2(16, 7), 0.8f));
+
+  // The partial tiles at the right and bottom edge work the same.
+  for (int y = 8; y < 12; ++y) {
+    for (int x = 16; x < 20; ++x)
+      depth.plot(x, y, 0.1f);
+  }
+  depth.updateTile(19, 11);
+  assert(depth.getTileMax(16, 8) == 0.1f);
+  return 0;
+}
+
+int testHierarchicalDepthMatchesFlat(bool tiled) {
+  VertexList vertices;
+  IndexList indices;
+  makeRandomTriangles(vertices, indices);
+
+  // Draw everything twice, the second time a little further back, so that
+  // most of it is hidden.
+  const size_t count = vertices.size();
+  for (size_t i = 0; i < count; ++i) {
+    Vertex v = vertices[i];
+    v.position.z = glm::min(v.position.z + 0.05f, 1.f);
+    vertices.push_back(v);
+    indices.push_back(vertices.size() - 1);
+  }
+
+  RenderConfig flat = makeRenderConfig();
+  flat.hierarchicalDepthTest = false;
+  flat.tiledRasterization = tiled;
+  Rasterizer().drawTriangles(flat, vertices, indices);
+
+  RenderConfig hierarchical = makeRenderConfig();
+  hierarchical.tiledRasterization = tiled;
+  Rasterizer().drawTriangles(hierarchical, vertices, indices);
+
+  assertBuffersEqual(flat, hierarchical);
+  return 0;
+}
+
+int testDepthPrepass() {
+  VertexList vertices;
+  IndexList indices;
+  makeRandomTriangles(vertices, indices);
+
+  for (bool tiled : {false, true}) {
+    Rasterizer single;
+    RenderConfig combined = makeRenderConfig();
+    combined.tiledRasterization = tiled;
+    single.drawTriangles(combined, vertices, indices);
+
+    // Depth first, then shade the visible fragments; every pixel is shaded at
+    // most once. The second pass sees the final depth buffer, so the
+    // hierarchical depth test skips even more fragments.
+    Rasterizer twoPass;
+    RenderConfig prepass = makeRenderConfig();
+    prepass.tiledRasterization = tiled;
+    prepass.depthPass = DepthPass::DEPTH_ONLY;
+    twoPass.drawTriangles(prepass, vertices, indices);
+    assert(twoPass.getDebugInfo().fragmentsShaded == 0);
+    assert(twoPass.getDebugInfo().fragmentsRasterized ==
+           single.getDebugInfo().fragmentsRasterized);
+
+    twoPass.resetDebugInfo();
+    prepass.depthPass = DepthPass::SHADE_VISIBLE;
+    twoPass.drawTriangles(prepass, vertices, indices);
+    assert(twoPass.getDebugInfo().fragmentsRasterized <
+           single.getDebugInfo().fragmentsRasterized);
+
+    assertBuffersEqual(combined, prepass);
+
+    int covered = 0;
+    for (unsigned int y = 0; y < HEIGHT; ++y) {
+      for (unsigned int x = 0; x < WIDTH; ++x) {
+        if (prepass.depthbuffer->getDepth(x, y) < 1.f)
+          ++covered;
+      }
+    }
+    assert(twoPass.getDebugInfo().fragmentsShaded == covered);
+    assert(single.getDebugInfo().fragmentsShaded > covered);
+  }
+
+  // A quad of two triangles at the same depth. The pixels on the diagonal pass
+  // the equal test for both triangles unless only one of them covers them.
+  VertexList quad;
+  for (const vec2 &p : {vec2(-0.5f, -0.5f), vec2(0.5f, -0.5f),
+                        vec2(0.5f, 0.5f), vec2(-0.5f, 0.5f)}) {
+    quad.push_back(Vertex(vec4(p, 0.f, 1.f)));
+  }
+  const IndexList quadIndices = {0, 1, 2, 0, 2, 3};
+
+  for (bool tiled : {false, true}) {
+    Rasterizer rasterizer;
+    RenderConfig config = makeRenderConfig();
+    config.tiledRasterization = tiled;
+    config.depthPass = DepthPass::DEPTH_ONLY;
+    rasterizer.drawTriangles(config, quad, quadIndices);
+
+    int covered = 0;
+    for (unsigned int y = 0; y < HEIGHT; ++y) {
+      for (unsigned int x = 0; x < WIDTH; ++x) {
+        if (config.depthbuffer->getDepth(x, y) < 1.f)
+          ++covered;
+      }
+    }
+    assert(covered > 0);
+    assert(rasterizer.getDebugInfo().fragmentsRasterized == covered);
+
+    rasterizer.resetDebugInfo();
+    config.depthPass = DepthPass::SHADE_VISIBLE;
+    rasterizer.drawTriangles(config, quad, quadIndices);
+    assert(rasterizer.getDebugInfo().fragmentsShaded == covered);
+  }
+
+  return 0;
+}
+
+int testDeferredShading(bool tiled) {
+  VertexList vertices;
+  IndexList indices;
+  makeRandomTriangles(vertices, indices);
+
+  Rasterizer forward;
+  RenderConfig forwardConfig = makeRenderConfig();
+  forwardConfig.tiledRasterization = tiled;
+  forward.drawTriangles(forwardConfig, vertices, indices);
+
+  // Rasterization only fills the G-buffer, the framebuffer stays untouched.
+  Rasterizer deferred;
+  RenderConfig deferredConfig = makeRenderConfig();
+  deferredConfig.tiledRasterization = tiled;
+  deferredConfig.gbuffer = std::make_shared<GBuffer>(WIDTH, HEIGHT);
+  deferred.drawTriangles(deferredConfig, vertices, indices);
+  assert(deferred.getDebugInfo().fragmentsShaded == 0);
+  for (unsigned int y = 0; y < HEIGHT; ++y) {
+    for (unsigned int x = 0; x < WIDTH; ++x) {
+      assert(deferredConfig.framebuffer->getPixel(x, y) == vec4(0, 0, 0, 1));
+      assert(deferredConfig.gbuffer->isCovered(x, y) ==
+             (deferredConfig.depthbuffer->getDepth(x, y) < 1.f));
+    }
+  }
+
+  // The shading pass shades every covered pixel once.
+  deferred.resetDebugInfo();
+  deferred.shadeGBuffer(deferredConfig);
+  assertBuffersEqual(forwardConfig, deferredConfig);
+
+  int covered = 0;
+  for (unsigned int y = 0; y < HEIGHT; ++y) {
+    for (unsigned int x = 0; x < WIDTH; ++x) {
+      if (deferredConfig.gbuffer->isCovered(x, y))
+        ++covered;
+    }
+  }
+  assert(deferred.getDebugInfo().fragmentsShaded == covered);
+  assert(forward.getDebugInfo().fragmentsShaded > covered);
+
+  // Without a depth buffer the G-buffer would keep the last fragment rather
+  // than the nearest one.
+  deferredConfig.depthbuffer.reset();
+  assert(!deferredConfig.isValid());
+
+  return 0;
+}
+
+int testFramebufferFormats() {
+  // Round trips through the packed formats.
+  Framebuffer rgba8(1, 1, PixelFormat::RGBA8);
+  assert(rgba8.getBytesPerPixel() == 4);
+  rgba8.plot(0, 0, vec4(1.f, 0.5f, -1.f, 2.f));
+  const unsigned char *bytes = (const unsigned char *)rgba8.getData();
+  assert(bytes[0] == 255 && bytes[1] == 128 && bytes[2] == 0 &&
+         bytes[3] == 255);
+  assert(rgba8.getPixel(0, 0) == vec4(1.f, 128 / 255.f, 0.f, 1.f));
+
+  Framebuffer rgb565(1, 1, PixelFormat::RGB565);
+  assert(rgb565.getBytesPerPixel() == 2);
+  rgb565.clear(vec4(1.f, 0.f, 1.f, 0.5f));
+  assert(*(const unsigned short *)rgb565.getData() == 0xf81f);
+  assert(rgb565.getPixel(0, 0) == vec4(1.f, 0.f, 1.f, 1.f));
+
+  // Rendering to a packed framebuffer gives the quantized colors of rendering
+  // to a float one; blending reads the packed colors back, so rounding errors
+  // may add up a little.
+  VertexList vertices;
+  IndexList indices;
+  makeRandomTriangles(vertices, indices);
+
+  for (bool blending : {false, true}) {
+    RenderConfig reference = makeRenderConfig();
+    reference.alphaBlending = blending;
+    Rasterizer().drawTriangles(reference, vertices, indices);
+
+    RenderConfig packed = makeRenderConfig();
+    packed.framebuffer =
+        std::make_shared<Framebuffer>(WIDTH, HEIGHT, PixelFormat::RGBA8);
+    packed.clearBuffers(vec4(0, 0, 0, 1));
+    packed.alphaBlending = blending;
+    Rasterizer().drawTriangles(packed, vertices, indices);
+
+    const float tolerance = blending ? 2.f / 255 : 0.5f / 255 + 1e-6f;
+    for (unsigned int y = 0; y < HEIGHT; ++y) {
+      for (unsigned int x = 0; x < WIDTH; ++x) {
+        const vec4 d = glm::abs(reference.framebuffer->getPixel(x, y) -
+                                packed.framebuffer->getPixel(x, y));
+        assert(d.r <= tolerance && d.g <= tolerance && d.b <= tolerance &&
+               d.a <= tolerance);
+      }
+    }
+  }
+
+  return 0;
+}
+
+int testDepthFormats() {
+  // Fixed point depth is truncated, and the depth test agrees with the
+  // converted-back value.
+  Depthbuffer unorm16(1, 1, DepthFormat::UNORM16);
+  unorm16.clear();
+  assert(unorm16.getDepth(0, 0) == 1.f);
+  assert(!unorm16.isVisible(0, 0, 1.f));
+  unorm16.plot(0, 0, 0.5f);
+  assert(unorm16.getDepth(0, 0) == 32767 / 65535.f);
+  assert(unorm16.isEqual(0, 0, 0.5f));
+  assert(!unorm16.isVisible(0, 0, 0.5f));
+  assert(unorm16.isVisible(0, 0, 32766.9f / 65535.f));
+  assert(unorm16.getTileMin(0, 0) == unorm16.getDepth(0, 0));
+
+  Depthbuffer unorm24(1, 1, DepthFormat::UNORM24);
+  unorm24.clear();
+  assert(unorm24.getDepth(0, 0) == 1.f);
+  assert(unorm24.conditionalPlot(0, 0, 0.25f));
+  assert(!unorm24.conditionalPlot(0, 0, 0.25f));
+  assert(glm::abs(unorm24.getDepth(0, 0) - 0.25f) < 1.f / 0xffffff);
+
+  VertexList vertices;
+  IndexList indices;
+  makeRandomTriangles(vertices, indices);
+
+  RenderConfig reference = makeRenderConfig();
+  Rasterizer().drawTriangles(reference, vertices, indices);
+
+  for (DepthFormat format : {DepthFormat::UNORM16, DepthFormat::UNORM24}) {
+    auto makeConfig = [format]() {
+      RenderConfig config = makeRenderConfig();
+      config.depthbuffer =
+          std::make_shared<Depthbuffer>(WIDTH, HEIGHT, format);
+      config.clearBuffers(vec4(0, 0, 0, 1));
+      return config;
+    };
+
+    // The hierarchical depth test is exact in every format.
+    RenderConfig flat = makeConfig();
+    flat.hierarchicalDepthTest = false;
+    Rasterizer().drawTriangles(flat, vertices, indices);
+
+    RenderConfig hierarchical = makeConfig();
+    Rasterizer().drawTriangles(hierarchical, vertices, indices);
+    assertBuffersEqual(flat, hierarchical);
+
+    // Apart from where triangles intersect, the image is the same as with
+    // float depth.
+    int different = 0;
+    for (unsigned int y = 0; y < HEIGHT; ++y) {
+      for (unsigned int x = 0; x < WIDTH; ++x) {
+        if (flat.framebuffer->getPixel(x, y) !=
+            reference.framebuffer->getPixel(x, y))
+          ++different;
+      }
+    }
+    assert(different < (int)(WIDTH * HEIGHT) / 100);
+  }
+
+  return 0;
+}
+
+int testLazyClear() {
+  // A buffer size that is not a multiple of the tile size.
+  const unsigned int w = 21, h = 13;
+  const vec4 red(1, 0, 0, 1), blue(0, 0, 1, 1);
+
+  for (PixelFormat format : {PixelFormat::RGBA32F, PixelFormat::RGBA8,
+                             PixelFormat::RGB565}) {
+    // Reads return the clear color before anything was written, and the
+    // neighbours of written pixels keep it.
+    Framebuffer framebuffer(w, h, format);
+    framebuffer.clear(red);
+    assert(framebuffer.getPixel(20, 12) == red);
+    framebuffer.plot(9, 9, blue);
+    framebuffer.plot(20, 12, blue);
+    framebuffer.clear(blue);
+    framebuffer.clear(red);
+    framebuffer.plot(9, 9, blue);
+    for (unsigned int y = 0; y < h; ++y) {
+      for (unsigned int x = 0; x < w; ++x) {
+        assert(framebuffer.getPixel(x, y) == (x == 9 && y == 9 ? blue : red));
+      }
+    }
+
+    // So does the raw data, both after a partial and a full clear.
+    Framebuffer reference(w, h, format);
+    for (unsigned int y = 0; y < h; ++y) {
+      for (unsigned int x = 0; x < w; ++x) {
+        reference.plot(x, y, x == 9 && y == 9 ? blue : red);
+      }
+    }
+    const size_t size = w * h * framebuffer.getBytesPerPixel();
+    assert(!memcmp(framebuffer.getData(), reference.getData(), size));
+
+    framebuffer.clear(red);
+    reference.plot(9, 9, red);
+    assert(!memcmp(framebuffer.getData(), reference.getData(), size));
+  }
+
+  for (DepthFormat format : {DepthFormat::FLOAT32, DepthFormat::UNORM16,
+                             DepthFormat::UNORM24}) {
+    Depthbuffer depthbuffer(w, h, format);
+    depthbuffer.plot(3, 3, 0.5f);
+    depthbuffer.clear();
+    assert(depthbuffer.isVisible(3, 3, 0.75f));
+    assert(depthbuffer.conditionalPlot(3, 3, 0.25f));
+    assert(!depthbuffer.isVisible(3, 3, 0.5f));
+    assert(depthbuffer.isVisible(4, 3, 0.5f));
+
+    // Span tests across tile borders, into cleared and written tiles.
+    const float z[32] = {0.5f, 0.5f, 0.5f, 0.5f, 0.5f, 0.5f, 0.5f, 0.5f,
+                         0.5f, 0.5f, 0.5f, 0.5f, 0.5f, 0.5f, 0.5f, 0.5f};
+    assert(depthbuffer.getVisibleMask(0, 3, z, 16) == (0xffffu & ~(1u << 3)));
+    assert(depthbuffer.getVisibleMask(2, 3, z, 16) == (0xffffu & ~(1u << 1)));
+
+    depthbuffer.resolveClears();
+    const float cleared = depthbuffer.getDepth(0, 0);
+    for (unsigned int y = 0; y < h; ++y) {
+      for (unsigned int x = 0; x < w; ++x) {
+        assert(depthbuffer.getDepth(x, y) == (x == 3 && y == 3
+                                                  ? depthbuffer.getDepth(3, 3)
+                                                  : cleared));
+      }
+    }
+    assert(depthbuffer.getDepth(3, 3) < 0.5f);
+  }
+
+  // Rendering with lazily cleared buffers matches rendering with buffers that
+  // have been cleared completely.
+  VertexList vertices;
+  IndexList indices;
+  makeRandomTriangles(vertices, indices);
+
+  RenderConfig lazy = makeRenderConfig();
+  lazy.tiledRasterization = true;
+  Rasterizer().drawTriangles(lazy, vertices, indices);
+
+  RenderConfig resolved = makeRenderConfig();
+  resolved.tiledRasterization = true;
+  resolved.framebuffer->resolveClears();
+  resolved.depthbuffer->resolveClears();
+  Rasterizer().drawTriangles(resolved, vertices, indices);
+
+  assertBuffersEqual(lazy, resolved);
+  return 0;
+}
+
+int testTiledLayout() {
+  VertexList vertices;
+  IndexList indices;
+  makeRandomTriangles(vertices, indices);
+
+  for (bool tiled : {false, true}) {
+    RenderConfig linear = makeRenderConfig();
+    linear.tiledRasterization = tiled;
+    Rasterizer().drawTriangles(linear, vertices, indices);
+
+    RenderConfig tiledLayout = makeRenderConfig();
+    tiledLayout.tiledRasterization = tiled;
+    tiledLayout.framebuffer = std::make_shared<Framebuffer>(
+        WIDTH, HEIGHT, PixelFormat::RGBA8, BufferLayout::TILED);
+    tiledLayout.depthbuffer = std::make_shared<Depthbuffer>(
+        WIDTH, HEIGHT, DepthFormat::FLOAT32, BufferLayout::TILED);
+    tiledLayout.clearBuffers(vec4(0, 0, 0, 1));
+    Rasterizer().drawTriangles(tiledLayout, vertices, indices);
+
+    // Same pixels, and the readback is row by row.
+    Framebuffer packed(WIDTH, HEIGHT, PixelFormat::RGBA8);
+    for (unsigned int y = 0; y < HEIGHT; ++y) {
+      for (unsigned int x = 0; x < WIDTH; ++x) {
+        assert(linear.depthbuffer->getDepth(x, y) ==
+               tiledLayout.depthbuffer->getDepth(x, y));
+        packed.plot(x, y, linear.framebuffer->getPixel(x, y));
+      }
+    }
+    // Written as PPM straight from the linear buffer and pixel by pixel from
+    // the tiled one, the frames are the same.
+    const std::string filename = "gfx93-rasterizer-test-layout.ppm";
+    assert(writePPM(filename, packed));
+    const std::unique_ptr<Image> fromLinear = readPPM(filename);
+    assert(writePPM(filename, *tiledLayout.framebuffer));
+    const std::unique_ptr<Image> fromTiled = readPPM(filename);
+    std::remove(filename.c_str());
+    assert(fromLinear && fromTiled && fromLinear->pixels == fromTiled->pixels);
+
+    assert(!memcmp(packed.getData(), tiledLayout.framebuffer->getData(),
+                   WIDTH * HEIGHT * 4));
+  }
+
+  return 0;
+}
+
+int testTexcoordDerivatives() {
+  // A quad covering the viewport, with texture coordinates running from 0 to
+  // 1 across it; texture coordinates then change by one over the viewport
+  // size from one pixel to the next.
+  VertexList vertices;
+  const vec2 corners[] = {vec2(0, 0), vec2(1, 0), vec2(1, 1), vec2(0, 1)};
+  for (const vec2 &c : corners) {
+    vertices.push_back(Vertex(vec4(c * 2.f - 1.f, 0.f, 1.f), vec3(0, 0, 1),
+                              vec4(1), c));
+  }
+  IndexList indices = {0, 1, 2, 0, 2, 3};
+
+  RenderConfig config = makeRenderConfig();
+  config.gbuffer = std::make_shared<GBuffer>(WIDTH, HEIGHT);
+  Rasterizer().drawTriangles(config, vertices, indices);
+
+  for (unsigned int y = 0; y < HEIGHT; ++y) {
+    for (unsigned int x = 0; x < WIDTH; ++x) {
+      assert(config.gbuffer->isCovered(x, y));
+      const ShadingGeometry g = config.gbuffer->read(x, y);
+      assert(std::abs(std::abs(g.texcoordDx.x) - 1.f / WIDTH) < 1e-5f);
+      assert(std::abs(g.texcoordDx.y) < 1e-5f);
+      assert(std::abs(g.texcoordDy.x) < 1e-5f);
+      assert(std::abs(std::abs(g.texcoordDy.y) - 1.f / HEIGHT) < 1e-5f);
+
+      // The derivatives match the differences to the neighbouring pixels.
+      if (x + 1 < WIDTH) {
+        const vec2 d = config.gbuffer->read(x + 1, y).texcoord - g.texcoord;
+        assert(std::abs(d.x - g.texcoordDx.x) < 1e-4f);
+      }
+      if (y + 1 < HEIGHT) {
+        const vec2 d = config.gbuffer->read(x, y + 1).texcoord - g.texcoord;
+        assert(std::abs(d.y - g.texcoordDy.y) < 1e-4f);
+      }
+    }
+  }
+
+  return 0;
+}
+
+int testFrameSink() {
+  VertexList vertices;
+  IndexList indices;
+  makeRandomTriangles(vertices, indices);
+
+  // Render more frames than there are buffers, each a little different.
+  const int frameCount = 5;
+  FrameSink sink(WIDTH, HEIGHT, PixelFormat::RGBA8, 2);
+  std::vector<Framebuffer *> used;
+  for (int i = 0; i < frameCount; ++i) {
+    RenderConfig config = makeRenderConfig();
+    config.framebuffer = sink.acquire();
+    config.clearBuffers(vec4(0, 0, i * 0.2f, 1));
+    Rasterizer().drawTriangles(config, vertices, indices);
+    sink.submit(config.framebuffer,
+                "gfx93-frame-sink-" + std::to_string(i) + ".ppm");
+
+    if (std::find(used.begin(), used.end(), config.framebuffer.get()) ==
+        used.end())
+      used.push_back(config.framebuffer.get());
+  }
+  sink.flush();
+  assert(sink.getWriteErrors() == 0);
+  assert(used.size() == sink.getBufferCount());
+
+  // Every file holds its own frame.
+  for (int i = 0; i < frameCount; ++i) {
+    RenderConfig reference = makeRenderConfig();
+    reference.framebuffer =
+        std::make_shared<Framebuffer>(WIDTH, HEIGHT, PixelFormat::RGBA8);
+    reference.clearBuffers(vec4(0, 0, i * 0.2f, 1));
+    Rasterizer().drawTriangles(reference, vertices, indices);
+
+    const std::string filename =
+        "gfx93-frame-sink-" + std::to_string(i) + ".ppm";
+    const std::unique_ptr<Image> image = readPPM(filename);
+    assert(image && image->width == WIDTH && image->height == HEIGHT);
+    const unsigned char *rgba =
+        (const unsigned char *)reference.framebuffer->getData();
+    for (unsigned int p = 0; p < WIDTH * HEIGHT; ++p) {
+      assert(memcmp(&image->pixels[p * 3], &rgba[p * 4], 3) == 0);
+    }
+    std::remove(filename.c_str());
+  }
+
+  // Nothing can be written to a missing directory.
+  sink.submit(sink.acquire(), "gfx93-missing-directory/frame.ppm");
+  sink.flush();
+  assert(sink.getWriteErrors() == 1);
+
+  return 0;
+}
+
+int main(int argc, const char **argv) {
+  const std::string test(argv[1]);
+
+  if (test == "tiled-matches-serial") {
+    return testTiledMatchesSerial(4);
+  }
+
+  if (test == "tiled-single-thread") {
+    return testTiledMatchesSerial(1);
+  }
+
+  if (test == "triangle-coverage") {
+    return testTriangleCoverage();
+  }
+
+  if (test == "simd-kernels-match-scalar") {
+    return testSimdKernelsMatchScalar();
+  }
+
+  if (test == "batch-shading-matches-single") {
+    return testBatchShadingMatchesSingle();
+  }
+
+  if (test == "vertex-batch-matches-single") {
+    return testVertexBatchMatchesSingle();
+  }
+
+  if (test == "threaded-vertex-processing") {
+    return testThreadedVertexProcessing();
+  }
+
+  if (test == "vertex-cache-skips-unused") {
+    return testVertexCacheSkipsUnusedVertices();
+  }
+
+  if (test == "vertex-buffer-caches-transform") {
+    return testVertexBufferCachesTransform();
+  }
+
+  if (test == "vertex-buffer-derived-shader") {
+    return testVertexBufferDerivedShader();
+  }
+
+  if (test == "face-culling") {
+    return testFaceCulling();
+  }
+
+  if (test == "guard-band-clipping") {
+    return testGuardBandClipping();
+  }
+
+  if (test == "hierarchical-depth-bounds") {
+    return testHierarchicalDepthBounds();
+  }
+
+  if (test == "hierarchical-depth-matches-flat") {
+    return testHierarchicalDepthMatchesFlat(false);
+  }
+
+  if (test == "hierarchical-depth-tiled") {
+    return testHierarchicalDepthMatchesFlat(true);
+  }
+
+  if (test == "depth-prepass") {
+    return testDepthPrepass();
+  }
+
+  if (test == "deferred-shading") {
+    return testDeferredShading(false);
+  }
+
+  if (test == "deferred-shading-tiled") {
+    return testDeferredShading(true);
+  }
+
+  if (test == "framebuffer-formats") {
+    return testFramebufferFormats();
+  }
+
+  if (test == "depth-formats") {
+    return testDepthFormats();
+  }
+
+  if (test == "lazy-clear") {
+    return testLazyClear();
+  }
+
+  if (test == "tiled-layout") {
+    return testTiledLayout();
+  }
+
+  if (test == "texcoord-derivatives") {
+    return testTexcoordDerivatives();
+  }
+
+  if (test == "frame-sink") {
+    return testFrameSink();
+  }
+
+  return 0;
+}
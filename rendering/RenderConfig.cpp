@@ -6,6 +6,8 @@ void RenderConfig::clearBuffers(const glm::vec4 &clearColor) {
     framebuffer->clear(clearColor);
   if (depthbuffer)
     depthbuffer->clear();
+  if (gbuffer)
+    gbuffer->clear();
 }
 
 bool RenderConfig::hasValidRenderOutput() const {
@@ -17,7 +19,24 @@ bool RenderConfig::hasValidRenderOutput() const {
       return false;
   }
 
+  // Same for the G-buffer.
+  if (gbuffer) {
+    if ((framebuffer && (framebuffer->getWidth() != gbuffer->getWidth() ||
+                         framebuffer->getHeight() != gbuffer->getHeight())) ||
+        (depthbuffer && (depthbuffer->getWidth() != gbuffer->getWidth() ||
+                         depthbuffer->getHeight() != gbuffer->getHeight())))
+      return false;
+  }
+
+  // The depth pre-pass works on the depth buffer only.
+  if (depthPass != DepthPass::COMBINED && !depthbuffer)
+    return false;
+
+  // The G-buffer relies on the depth test to keep the nearest fragment.
+  if (gbuffer && !depthbuffer)
+    return false;
+
   // Make sure we have a viewport and at least a single render target.
-  return viewport && (framebuffer || depthbuffer);
+  return viewport && (framebuffer || depthbuffer || gbuffer);
 }
 } // namespace render
@@ -7,6 +7,8 @@
 
 #include "Depthbuffer.h"
 #include "Framebuffer.h"
+#include "GBuffer.h"
+#include "RasterKernel.h"
 
 namespace render {
 
@@ -15,6 +17,35 @@ class FragmentShader;
 
 class Viewport;
 
+// Which triangles are discarded based on their winding order. Triangles whose
+// corners are counter-clockwise on screen are front facing.
+enum class CullMode {
+  // Draw all triangles, no matter which way they face.
+  NONE,
+  // Discard back-facing (clockwise) triangles.
+  BACK,
+  // Discard front-facing (counter-clockwise) triangles.
+  FRONT
+};
+
+// Which part of the depth pre-pass a draw call performs. Rendering a scene
+// twice -- first DEPTH_ONLY, then SHADE_VISIBLE with the same geometry and
+// configuration -- runs the fragment shader exactly once per visible pixel,
+// which pays off for expensive fragment shaders and lots of overdraw. Pixels
+// on an edge shared by two triangles belong to only one of them.
+enum class DepthPass {
+  // Regular rendering: depth test, shading and writing in one go.
+  COMBINED,
+  // Only depth values are written; the fragment shader is not called. This is
+  // also what happens if no framebuffer is set.
+  DEPTH_ONLY,
+  // Only fragments whose depth equals the stored depth are shaded. The depth
+  // buffer is not written to. With fixed point depth formats, fragments of
+  // different triangles may round to the same depth; all of them are shaded
+  // and the last one wins.
+  SHADE_VISIBLE
+};
+
 // Describes the configuration, input/output and options that will be used to
 // render primitives. This is passed in explicitly to the various rasterization
 // methods.
@@ -24,6 +55,14 @@ struct RenderConfig {
   std::shared_ptr<Framebuffer> framebuffer;
   std::shared_ptr<Depthbuffer> depthbuffer;
 
+  // Deferred shading: if set, rasterization stores the visible fragments'
+  // attributes in the G-buffer instead of shading them, and the framebuffer is
+  // left alone. Rasterizer::shadeGBuffer() shades them afterwards. Requires a
+  // depthbuffer, and must have the same dimensions as the other buffers. As
+  // only the nearest fragment of each pixel is kept, alpha blending and
+  // discarded fragments only affect the shading pass.
+  std::shared_ptr<GBuffer> gbuffer;
+
   // The viewport within the buffers we're rendering to.
   std::shared_ptr<Viewport> viewport;
 
@@ -39,12 +78,52 @@ struct RenderConfig {
   // function.
   bool alphaBlending = false;
 
+  // Enable/disable tile-based rasterization. When enabled, triangles are
+  // sorted into screen tiles of tileSize x tileSize pixels after clipping and
+  // the tiles are rasterized in parallel by the rasterizer's worker threads.
+  // Every tile owns its region of the output buffers, so no locking takes
+  // place; the fragment shader, however, is called from several threads at
+  // once and must not modify shared state.
+  bool tiledRasterization = false;
+  int tileSize = 64;
+
+  // Enable/disable splitting the vertex transform of large draws over the
+  // rasterizer's worker threads. As above, the vertex shader is then called
+  // from several threads at once.
+  bool threadedVertexProcessing = false;
+
+  // Instruction set of the kernel that computes triangle coverage, barycentric
+  // coordinates and depth. AUTO picks the widest one the CPU supports; SCALAR
+  // is the portable reference implementation.
+  SimdKernel coverageKernel = SimdKernel::AUTO;
+
+  // Selects the triangles that are discarded before clipping and rasterization,
+  // based on which way they face. Back faces are culled by default.
+  CullMode cullMode = CullMode::BACK;
+
+  // Enable/disable guard band clipping. When enabled, triangles that extend
+  // past the sides of the view volume are not clipped; the rasterizer only
+  // visits the part of their bounding box that is inside the viewport. Only
+  // triangles that cross the near or far plane, or that reach very far to the
+  // sides, are clipped.
+  bool guardBandClipping = true;
+
+  // Enable/disable the hierarchical depth test. When enabled, triangles and
+  // 8x8 pixel blocks are tested against the depth bounds of the depth buffer
+  // tiles first and skipped if they are hidden. Otherwise, only single pixels
+  // are tested.
+  bool hierarchicalDepthTest = true;
+
+  // Selects the depth pre-pass step this configuration is used for; see
+  // DepthPass. Both pre-pass steps require a depth buffer.
+  DepthPass depthPass = DepthPass::COMBINED;
+
   // Debug flags follow.
 
   // If set to true, bounding areas will be drawn around rasterized triangles.
   bool drawTriangleBounds = false;
 
-  // Utility method to clear both frame and depth buffer with a single call.
+  // Utility method to clear all output buffers with a single call.
   void clearBuffers(const glm::vec4 &clearColor);
 
   // Checks that we have at least a single render target and a viewport and that
@@ -5,6 +5,8 @@
 #ifndef GFX1993_RENDERDEBUGINFO_H
 #define GFX1993_RENDERDEBUGINFO_H
 
+#include <atomic>
+
 namespace render
 {
 
@@ -16,13 +18,30 @@ struct DebugInfo
   int linesDrawn = 0;
   int trianglesDrawn = 0;
 
+  // Triangles discarded by face culling, and triangles that had to be clipped.
+  int trianglesCulled = 0;
+  int trianglesClipped = 0;
+
+  // Vertices that went through the vertex shader; cached vertices don't count.
+  int verticesTransformed = 0;
 
+  // Pixels covered by primitives, and fragments that went through the fragment
+  // shader. Their ratio shows how much shading is wasted on hidden fragments.
+  // Blocks skipped by the hierarchical depth test are not rasterized at all.
+  // Updated from the rasterizer threads, hence atomic.
+  std::atomic<int> fragmentsRasterized{0};
+  std::atomic<int> fragmentsShaded{0};
 
   inline void reset()
   {
     pointsDrawn = 0;
     linesDrawn = 0;
     trianglesDrawn = 0;
+    trianglesCulled = 0;
+    trianglesClipped = 0;
+    verticesTransformed = 0;
+    fragmentsRasterized = 0;
+    fragmentsShaded = 0;
   }
 
 };
@@ -1,5 +1,12 @@
 #include "Shader.h"
 
+#include <atomic>
+#include <typeinfo>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
 using glm::mat3;
 using glm::mat4;
 using glm::vec3;
@@ -7,7 +14,16 @@ using glm::vec4;
 
 namespace render {
 
-VertexOut &&DefaultVertexTransform::transformSingle(const Vertex &in) {
+static uint64_t makeShaderId() {
+  static std::atomic<uint64_t> nextId(1);
+  return nextId++;
+}
+
+VertexShader::VertexShader() : id(makeShaderId()) {}
+
+VertexShader::VertexShader(const VertexShader &) : id(makeShaderId()) {}
+
+VertexOut DefaultVertexTransform::transformSingle(const Vertex &in) {
   mat4 modelViewProjectionMatrix = projectionMatrix * viewMatrix * modelMatrix;
   // mat3 normalMatrix =
   // glm::inverse(glm::transpose(glm::mat3(modelViewMatrix)));
@@ -21,20 +37,168 @@ VertexOut &&DefaultVertexTransform::transformSingle(const Vertex &in) {
   result.color = in.color;
   result.texcoord = in.texcoord;
 
-  return std::move(result);
+  return result;
+}
+
+bool DefaultVertexTransform::isTransformCacheable() const {
+  return typeid(*this) == typeid(DefaultVertexTransform);
+}
+
+std::vector<float> DefaultVertexTransform::getTransformState() const {
+  std::vector<float> state;
+  state.reserve(48);
+  for (const mat4 *m : {&modelMatrix, &viewMatrix, &projectionMatrix}) {
+    for (int i = 0; i < 4; ++i) {
+      for (int j = 0; j < 4; ++j)
+        state.push_back((*m)[i][j]);
+    }
+  }
+  return state;
+}
+
+void VertexShader::transformBatch(const Vertex *in, VertexOut *out,
+                                  size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    out[i] = transformSingle(in[i]);
+  }
+}
+
+#ifdef __SSE__
+// A 4x4 matrix with every element broadcast into its own register. This is
+// used to transform four vectors given as structure-of-arrays (xxxx, yyyy,
+// zzzz, wwww) at once without any shuffling inside the product.
+struct BroadcastMatrix {
+  __m128 element[4][4];
+
+  explicit BroadcastMatrix(const mat4 &m) {
+    for (int col = 0; col < 4; ++col) {
+      for (int row = 0; row < 4; ++row) {
+        element[col][row] = _mm_set1_ps(m[col][row]);
+      }
+    }
+  }
+
+  // Transforms the four positions in[0..3] and stores the results in
+  // out[0..3].
+  inline void transform(const vec4 *in, vec4 *out) const {
+    // AoS -> SoA
+    __m128 x = _mm_loadu_ps(&in[0].x);
+    __m128 y = _mm_loadu_ps(&in[1].x);
+    __m128 z = _mm_loadu_ps(&in[2].x);
+    __m128 w = _mm_loadu_ps(&in[3].x);
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+
+    __m128 r[4];
+    for (int row = 0; row < 4; ++row) {
+      r[row] =
+          _mm_add_ps(_mm_add_ps(_mm_mul_ps(element[0][row], x),
+                                _mm_mul_ps(element[1][row], y)),
+                     _mm_add_ps(_mm_mul_ps(element[2][row], z),
+                                _mm_mul_ps(element[3][row], w)));
+    }
+
+    // SoA -> AoS
+    _MM_TRANSPOSE4_PS(r[0], r[1], r[2], r[3]);
+    for (int i = 0; i < 4; ++i) {
+      _mm_storeu_ps(&out[i].x, r[i]);
+    }
+  }
+};
+#endif
+
+void DefaultVertexTransform::transformBatch(const Vertex *in, VertexOut *out,
+                                            size_t count) {
+  const mat4 modelViewProjectionMatrix =
+      projectionMatrix * viewMatrix * modelMatrix;
+  const mat3 normalMatrix = mat3(modelMatrix);
+
+  size_t i = 0;
+
+#ifdef __SSE__
+  const BroadcastMatrix mvp(modelViewProjectionMatrix);
+  const BroadcastMatrix model(modelMatrix);
+
+  for (; i + 4 <= count; i += 4) {
+    const vec4 positions[4] = {in[i + 0].position, in[i + 1].position,
+                               in[i + 2].position, in[i + 3].position};
+    vec4 clipPositions[4], worldPositions[4];
+    mvp.transform(positions, clipPositions);
+    model.transform(positions, worldPositions);
+
+    for (int j = 0; j < 4; ++j) {
+      VertexOut &result = out[i + j];
+      result.clipPosition = clipPositions[j];
+      result.worldPosition = vec3(worldPositions[j]);
+      result.worldNormal = normalMatrix * in[i + j].normal;
+      result.color = in[i + j].color;
+      result.texcoord = in[i + j].texcoord;
+    }
+  }
+#endif
+
+  // Whatever is left over.
+  for (; i < count; ++i) {
+    VertexOut &result = out[i];
+    result.clipPosition = modelViewProjectionMatrix * in[i].position;
+    result.worldPosition = vec3(modelMatrix * in[i].position);
+    result.worldNormal = normalMatrix * in[i].normal;
+    result.color = in[i].color;
+    result.texcoord = in[i].texcoord;
+  }
+}
+
+void FragmentShader::shadeBatch(const ShadingGeometry *in, Fragment *out,
+                                size_t count, unsigned int mask) {
+  for (size_t i = 0; i < count; ++i) {
+    if (mask & (1u << i))
+      out[i] = shadeSingle(in[i]);
+  }
+}
+
+static inline Fragment shadeInputColor(const ShadingGeometry &in) {
+  return Fragment{in.color};
+}
+
+Fragment InputColorShader::shadeSingle(const ShadingGeometry &in) {
+  return shadeInputColor(in);
 }
 
-Fragment &&InputColorShader::shadeSingle(const ShadingGeometry &in) {
-  return std::move(Fragment{in.color});
+void InputColorShader::shadeBatch(const ShadingGeometry *in, Fragment *out,
+                                  size_t count, unsigned int mask) {
+  for (size_t i = 0; i < count; ++i) {
+    if (mask & (1u << i))
+      out[i] = shadeInputColor(in[i]);
+  }
 }
 
-Fragment &&NormalColorShader::shadeSingle(const ShadingGeometry &in) {
+static inline Fragment shadeNormalColor(const ShadingGeometry &in) {
   vec3 c = abs(normalize(in.normal));
-  return std::move(Fragment{vec4(c, 1.f)});
+  return Fragment{vec4(c, 1.f)};
+}
+
+Fragment NormalColorShader::shadeSingle(const ShadingGeometry &in) {
+  return shadeNormalColor(in);
+}
+
+void NormalColorShader::shadeBatch(const ShadingGeometry *in, Fragment *out,
+                                   size_t count, unsigned int mask) {
+  for (size_t i = 0; i < count; ++i) {
+    if (mask & (1u << i))
+      out[i] = shadeNormalColor(in[i]);
+  }
+}
+
+Fragment SingleColorShader::shadeSingle(const ShadingGeometry &in) {
+  return Fragment{color};
 }
 
-Fragment &&SingleColorShader::shadeSingle(const ShadingGeometry &in) {
-  return std::move(Fragment{color});
+void SingleColorShader::shadeBatch(const ShadingGeometry *in, Fragment *out,
+                                   size_t count, unsigned int mask) {
+  const Fragment fragment{color};
+  for (size_t i = 0; i < count; ++i) {
+    if (mask & (1u << i))
+      out[i] = fragment;
+  }
 }
 
 }
\ No newline at end of file
@@ -3,18 +3,47 @@
 
 #include "Pipeline.h"
 
+#include <cstdint>
+#include <vector>
+
 namespace render {
 
 // Base class for vertex transformations. This is called on all given vertices
 // for a draw operation.
 class VertexShader {
 public:
+  VertexShader();
+  // Copies get an id of their own; assignment keeps it.
+  VertexShader(const VertexShader &other);
+  inline VertexShader &operator=(const VertexShader &) { return *this; }
+
   virtual ~VertexShader() = default;
 
-  virtual VertexOut &&transformSingle(const Vertex &in) = 0;
+  virtual VertexOut transformSingle(const Vertex &in) = 0;
+
+  // Transforms count vertices from in to out. The default implementation calls
+  // transformSingle for each of them; shaders should override it to set up
+  // per-draw state only once. The rasterizer may call this concurrently on
+  // disjoint ranges of a draw.
+  virtual void transformBatch(const Vertex *in, VertexOut *out, size_t count);
+
+  // Whether vertex buffers may keep the output of this shader between draws.
+  // Shaders opt in by returning true, and then have to return everything
+  // besides the input vertex that the transform depends on from
+  // getTransformState(): transformed vertices are reused as long as both the
+  // shader and that state stay the same.
+  virtual bool isTransformCacheable() const { return false; }
+  virtual std::vector<float> getTransformState() const { return {}; }
+
+  // Unique to this shader object; unlike its address, never reused for
+  // another one.
+  inline uint64_t getId() const { return id; }
 
   // for STL algorithms
-  VertexOut &&operator()(const Vertex &in) { return transformSingle(in); }
+  VertexOut operator()(const Vertex &in) { return transformSingle(in); }
+
+private:
+  uint64_t id;
 };
 
 // Simulates the OpenGL fixed function pipeline. It transforms vertices using a
@@ -25,7 +54,19 @@ public:
   glm::mat4 viewMatrix;
   glm::mat4 projectionMatrix;
 
-  VertexOut &&transformSingle(const Vertex &in) override;
+  VertexOut transformSingle(const Vertex &in) override;
+
+  // Combines the matrices once per batch and transforms the positions four at
+  // a time in structure-of-arrays form.
+  void transformBatch(const Vertex *in, VertexOut *out, size_t count) override;
+
+  // Only DefaultVertexTransform itself opts in: a subclass may transform
+  // differently or depend on more than the three matrices, so it has to
+  // override both functions to have its output reused.
+  bool isTransformCacheable() const override;
+
+  // The three matrices.
+  std::vector<float> getTransformState() const override;
 };
 
 // Base class for shading fragments. This shader is called once the fragment
@@ -34,19 +75,32 @@ class FragmentShader {
 public:
   virtual ~FragmentShader() = default;
 
-  virtual Fragment &&shadeSingle(const ShadingGeometry &in) = 0;
+  virtual Fragment shadeSingle(const ShadingGeometry &in) = 0;
+
+  // Shades a batch of up to 32 fragments, e.g. a span of a triangle. Only the
+  // fragments in[i] with bit i of the mask set are shaded; their results are
+  // written to out[i]. The default implementation calls shadeSingle for each
+  // of them; shaders should override it to avoid a virtual call per fragment.
+  virtual void shadeBatch(const ShadingGeometry *in, Fragment *out,
+                          size_t count, unsigned int mask);
 };
 
 // Shades all fragments as the geometry's unlit color vertex attribute.
 class InputColorShader : public FragmentShader {
 public:
-  Fragment &&shadeSingle(const ShadingGeometry &in) override;
+  Fragment shadeSingle(const ShadingGeometry &in) override;
+
+  void shadeBatch(const ShadingGeometry *in, Fragment *out, size_t count,
+                  unsigned int mask) override;
 };
 
 // Shades all fragments as the underlying normal in world coordinates.
 class NormalColorShader : public FragmentShader {
 public:
-  Fragment &&shadeSingle(const ShadingGeometry &in) override;
+  Fragment shadeSingle(const ShadingGeometry &in) override;
+
+  void shadeBatch(const ShadingGeometry *in, Fragment *out, size_t count,
+                  unsigned int mask) override;
 };
 
 // Shades all fragments in a single, constant color.
@@ -54,7 +108,10 @@ class SingleColorShader : public FragmentShader {
 public:
   SingleColorShader(const glm::vec4 initialColor) : color(initialColor) {}
 
-  Fragment &&shadeSingle(const ShadingGeometry &in) override;
+  Fragment shadeSingle(const ShadingGeometry &in) override;
+
+  void shadeBatch(const ShadingGeometry *in, Fragment *out, size_t count,
+                  unsigned int mask) override;
 
   inline void setColor(const glm::vec4 &color) { this->color = color; }
 
@@ -4,30 +4,480 @@
 
 #include "Texture.h"
 
+#include <algorithm>
+#include <cfloat>
 #include <cmath>
-#include <fstream>
+#include <cstdint>
 #include <memory>
 
+#include "Image.h"
+
 namespace render {
 
-Texture::Texture(int width, int height) : width(width), height(height) {
-  data = new glm::vec4[width * height];
-  for (int i = 0; i < width * height; ++i) {
-    data[i] = glm::vec4(0, 0, 0, 1);
+namespace {
+
+// Texels per block edge of the block compressed formats.
+const int BLOCK_SIZE = 4;
+
+inline bool isBlockCompressed(TextureFormat format) {
+  return format == TextureFormat::BC1 || format == TextureFormat::BC3;
+}
+
+inline unsigned char toUnorm8(float c) {
+  return (unsigned char)(glm::clamp(c, 0.f, 1.f) * 255.f + 0.5f);
+}
+
+inline uint16_t packRGB565(const glm::vec3 &c) {
+  const glm::vec3 t = glm::clamp(c, 0.f, 1.f);
+  return (uint16_t)(t.r * 31.f + 0.5f) << 11 |
+         (uint16_t)(t.g * 63.f + 0.5f) << 5 | (uint16_t)(t.b * 31.f + 0.5f);
+}
+
+inline glm::vec3 unpackRGB565(uint16_t c) {
+  return glm::vec3((c >> 11) * (1.f / 31), (c >> 5 & 0x3f) * (1.f / 63),
+                   (c & 0x1f) * (1.f / 31));
+}
+
+inline uint16_t readUint16(const unsigned char *p) { return p[0] | p[1] << 8; }
+
+inline void writeUint16(unsigned char *p, uint16_t v) {
+  p[0] = v & 0xff;
+  p[1] = v >> 8;
+}
+
+// Color with the given index of a BC1 color block. With four colors, the two
+// in between are interpolated at thirds; otherwise there is a single one in
+// the middle and index 3 is transparent black. BC3 color blocks always have
+// four colors.
+inline glm::vec4 getBC1Color(const unsigned char *block, unsigned int index,
+                             bool fourColors) {
+  const glm::vec3 c0 = unpackRGB565(readUint16(block));
+  const glm::vec3 c1 = unpackRGB565(readUint16(block + 2));
+  switch (index) {
+  case 0:
+    return glm::vec4(c0, 1.f);
+  case 1:
+    return glm::vec4(c1, 1.f);
+  case 2:
+    return fourColors ? glm::vec4((2.f * c0 + c1) * (1.f / 3), 1.f)
+                      : glm::vec4((c0 + c1) * 0.5f, 1.f);
+  default:
+    return fourColors ? glm::vec4((c0 + 2.f * c1) * (1.f / 3), 1.f)
+                      : glm::vec4(0.f);
+  }
+}
+
+// Texel i of a BC1 color block, texels numbered row by row.
+inline glm::vec4 decodeBC1(const unsigned char *block, int i, bool bc3) {
+  const bool fourColors = bc3 || readUint16(block) > readUint16(block + 2);
+  return getBC1Color(block, block[4 + i / 4] >> (i % 4 * 2) & 3, fourColors);
+}
+
+// Alpha with the given index of a BC3 alpha block: six values between the end
+// points if the first is larger, otherwise four, followed by 0 and 1.
+inline float getBC3Alpha(const unsigned char *block, unsigned int index) {
+  const float a0 = block[0] * (1.f / 255), a1 = block[1] * (1.f / 255);
+  if (index < 2)
+    return index == 0 ? a0 : a1;
+  if (block[0] > block[1])
+    return ((8 - index) * a0 + (index - 1) * a1) * (1.f / 7);
+  if (index < 6)
+    return ((6 - index) * a0 + (index - 1) * a1) * (1.f / 5);
+  return index == 6 ? 0.f : 1.f;
+}
+
+inline float decodeBC3Alpha(const unsigned char *block, int i) {
+  uint64_t bits = 0;
+  for (int b = 5; b >= 0; --b)
+    bits = bits << 8 | block[2 + b];
+  return getBC3Alpha(block, bits >> (i * 3) & 7);
+}
+
+// Encodes 16 texels, row by row, into a BC1 color block. The end points are
+// the two colors of the block farthest apart, which is exact for blocks of two
+// colors; every texel then gets the closest color between them.
+void encodeBC1(const glm::vec4 *texels, unsigned char *block, bool bc3) {
+  bool transparent = false;
+  if (!bc3) {
+    for (int i = 0; i < 16; ++i)
+      transparent = transparent || texels[i].a < 0.5f;
+  }
+
+  int e0 = -1, e1 = -1;
+  float farthest = -1.f;
+  for (int i = 0; i < 16; ++i) {
+    if (transparent && texels[i].a < 0.5f)
+      continue;
+    for (int j = i; j < 16; ++j) {
+      if (transparent && texels[j].a < 0.5f)
+        continue;
+      const glm::vec3 d = glm::vec3(texels[i]) - glm::vec3(texels[j]);
+      if (glm::dot(d, d) > farthest) {
+        farthest = glm::dot(d, d);
+        e0 = i;
+        e1 = j;
+      }
+    }
+  }
+
+  // The order of the end points selects the mode.
+  uint16_t c0 = e0 < 0 ? 0 : packRGB565(glm::vec3(texels[e0]));
+  uint16_t c1 = e1 < 0 ? 0 : packRGB565(glm::vec3(texels[e1]));
+  if (transparent ? c0 > c1 : c0 < c1)
+    std::swap(c0, c1);
+  writeUint16(block, c0);
+  writeUint16(block + 2, c1);
+
+  const bool fourColors = bc3 || c0 > c1;
+  glm::vec3 colors[4];
+  for (int c = 0; c < 4; ++c)
+    colors[c] = glm::vec3(getBC1Color(block, c, fourColors));
+
+  for (int row = 0; row < 4; ++row) {
+    unsigned char indices = 0;
+    for (int i = row * 4 + 3; i >= row * 4; --i) {
+      int best = 3;
+      if (!transparent || texels[i].a >= 0.5f) {
+        float bestDistance = FLT_MAX;
+        for (int c = 0; c < (fourColors ? 4 : 3); ++c) {
+          const glm::vec3 d = colors[c] - glm::vec3(texels[i]);
+          if (glm::dot(d, d) < bestDistance) {
+            bestDistance = glm::dot(d, d);
+            best = c;
+          }
+        }
+      }
+      indices = indices << 2 | best;
+    }
+    block[4 + row] = indices;
+  }
+}
+
+// Encodes the alpha of 16 texels into a BC3 alpha block, using the range of
+// the block as end points.
+void encodeBC3Alpha(const glm::vec4 *texels, unsigned char *block) {
+  unsigned char a0 = 0, a1 = 255;
+  for (int i = 0; i < 16; ++i) {
+    a0 = std::max(a0, toUnorm8(texels[i].a));
+    a1 = std::min(a1, toUnorm8(texels[i].a));
+  }
+  block[0] = a0;
+  block[1] = a1;
+
+  // With equal end points every index gives a0.
+  uint64_t bits = 0;
+  for (int i = 15; i >= 0 && a0 > a1; --i) {
+    unsigned int best = 0;
+    float bestDistance = FLT_MAX;
+    for (unsigned int index = 0; index < 8; ++index) {
+      const float d = std::abs(getBC3Alpha(block, index) - texels[i].a);
+      if (d < bestDistance) {
+        bestDistance = d;
+        best = index;
+      }
+    }
+    bits = bits << 3 | best;
+  }
+  for (int b = 0; b < 6; ++b)
+    block[2 + b] = bits >> (b * 8) & 0xff;
+}
+
+} // namespace
+
+Texture::Texture(int width, int height)
+    : width(width), height(height), filter(TextureFilter::NEAREST),
+      format(TextureFormat::RGBA32F), layout(BufferLayout::LINEAR) {
+  // Halve the size down to 1x1; a level stays at 1 along an axis once it got
+  // there.
+  int w = width, h = height;
+  for (;;) {
+    levels.push_back(Level{w, h, 0, nullptr});
+    if (w == 1 && h == 1)
+      break;
+    w = std::max(w / 2, 1);
+    h = std::max(h / 2, 1);
+  }
+
+  allocateLevels();
+  for (size_t i = 0; i < levels.size(); ++i) {
+    std::fill_n(getFloatTexels(i), levels[i].width * levels[i].height,
+                glm::vec4(0, 0, 0, 1));
+  }
+}
+
+Texture::~Texture() = default;
+
+void Texture::allocateLevels() {
+  std::vector<size_t> offsets(levels.size());
+  storageSize = 0;
+  for (size_t i = 0; i < levels.size(); ++i) {
+    Level &level = levels[i];
+    offsets[i] = storageSize;
+
+    if (isBlockCompressed(format)) {
+      const unsigned int blocksX = (level.width + BLOCK_SIZE - 1) / BLOCK_SIZE;
+      const unsigned int blocksY = (level.height + BLOCK_SIZE - 1) / BLOCK_SIZE;
+      const size_t blockBytes = format == TextureFormat::BC1 ? 8 : 16;
+      level.tilesX = blocksX;
+      storageSize += blocksX * blocksY * blockBytes;
+    } else {
+      const unsigned int tilesX =
+          (level.width + BUFFER_TILE_SIZE - 1) / BUFFER_TILE_SIZE;
+      const unsigned int tilesY =
+          (level.height + BUFFER_TILE_SIZE - 1) / BUFFER_TILE_SIZE;
+      level.tilesX = tilesX;
+      storageSize +=
+          getBufferSize(layout, level.width, level.height, tilesX, tilesY) *
+          (format == TextureFormat::RGBA32F ? sizeof(glm::vec4) : 4);
+    }
+  }
+
+  // Allocated as vec4 for the alignment of RGBA32F.
+  data.reset(
+      new glm::vec4[(storageSize + sizeof(glm::vec4) - 1) / sizeof(glm::vec4)]);
+  unsigned char *bytes = reinterpret_cast<unsigned char *>(data.get());
+  for (size_t i = 0; i < levels.size(); ++i) {
+    levels[i].texels = bytes + offsets[i];
+  }
+}
+
+void Texture::setStorage(TextureFormat newFormat, BufferLayout newLayout) {
+  // Decode everything before the storage is replaced.
+  std::vector<std::vector<glm::vec4>> decoded(levels.size());
+  for (size_t i = 0; i < levels.size(); ++i) {
+    decoded[i].resize(levels[i].width * levels[i].height);
+    for (int y = 0; y < levels[i].height; ++y) {
+      for (int x = 0; x < levels[i].width; ++x) {
+        decoded[i][x + y * levels[i].width] = getTexel(i, x, y);
+      }
+    }
+  }
+
+  format = newFormat;
+  layout = newLayout;
+  allocateLevels();
+
+  for (size_t i = 0; i < levels.size(); ++i) {
+    const Level &level = levels[i];
+    const glm::vec4 *src = decoded[i].data();
+
+    if (!isBlockCompressed(format)) {
+      for (int y = 0; y < level.height; ++y) {
+        for (int x = 0; x < level.width; ++x) {
+          const unsigned int index =
+              getBufferIndex(layout, x, y, level.width, level.tilesX);
+          const glm::vec4 &c = src[x + y * level.width];
+          if (format == TextureFormat::RGBA32F) {
+            reinterpret_cast<glm::vec4 *>(level.texels)[index] = c;
+          } else {
+            unsigned char *texel = level.texels + index * 4;
+            for (int k = 0; k < 4; ++k)
+              texel[k] = toUnorm8(c[k]);
+          }
+        }
+      }
+      continue;
+    }
+
+    // Blocks reaching over the edge repeat the last row or column.
+    const size_t blockBytes = format == TextureFormat::BC1 ? 8 : 16;
+    unsigned char *block = level.texels;
+    for (int by = 0; by < level.height; by += BLOCK_SIZE) {
+      for (int bx = 0; bx < level.width; bx += BLOCK_SIZE) {
+        glm::vec4 texels[16];
+        for (int y = 0; y < BLOCK_SIZE; ++y) {
+          for (int x = 0; x < BLOCK_SIZE; ++x) {
+            texels[x + y * BLOCK_SIZE] =
+                src[std::min(bx + x, level.width - 1) +
+                    std::min(by + y, level.height - 1) * level.width];
+          }
+        }
+
+        if (format == TextureFormat::BC1) {
+          encodeBC1(texels, block, false);
+        } else {
+          encodeBC3Alpha(texels, block);
+          encodeBC1(texels, block + 8, true);
+        }
+        block += blockBytes;
+      }
+    }
   }
 }
 
-Texture::~Texture() { delete[] data; }
+void Texture::generateMipmaps() {
+  for (size_t i = 1; i < levels.size(); ++i) {
+    const Level &src = levels[i - 1];
+    const Level &dst = levels[i];
+    const glm::vec4 *srcTexels = getFloatTexels(i - 1);
+    glm::vec4 *dstTexels = getFloatTexels(i);
 
-const glm::vec4 &Texture::getTexel(const glm::vec2 &texCoords) const {
+    // Box filter over the 2x2 source texels; odd sizes repeat the last row or
+    // column.
+    for (int y = 0; y < dst.height; ++y) {
+      const int y0 = std::min(y * 2, src.height - 1);
+      const int y1 = std::min(y * 2 + 1, src.height - 1);
+      for (int x = 0; x < dst.width; ++x) {
+        const int x0 = std::min(x * 2, src.width - 1);
+        const int x1 = std::min(x * 2 + 1, src.width - 1);
+        dstTexels[x + y * dst.width] =
+            (srcTexels[x0 + y0 * src.width] + srcTexels[x1 + y0 * src.width] +
+             srcTexels[x0 + y1 * src.width] +
+             srcTexels[x1 + y1 * src.width]) *
+            0.25f;
+      }
+    }
+  }
+}
+
+template <TextureFormat F>
+glm::vec4 Texture::fetch(const Level &level, int x, int y) const {
+  if (F == TextureFormat::RGBA32F || F == TextureFormat::RGBA8) {
+    const unsigned int index =
+        getBufferIndex(layout, x, y, level.width, level.tilesX);
+    if (F == TextureFormat::RGBA32F)
+      return reinterpret_cast<const glm::vec4 *>(level.texels)[index];
+
+    const unsigned char *texel = level.texels + index * 4;
+    return glm::vec4(texel[0], texel[1], texel[2], texel[3]) * (1.f / 255);
+  }
+
+  const unsigned int blockIndex =
+      x / BLOCK_SIZE + y / BLOCK_SIZE * level.tilesX;
+  const int i = x % BLOCK_SIZE + y % BLOCK_SIZE * BLOCK_SIZE;
+  if (F == TextureFormat::BC1)
+    return decodeBC1(level.texels + blockIndex * 8, i, false);
+
+  const unsigned char *block = level.texels + blockIndex * 16;
+  glm::vec4 c = decodeBC1(block + 8, i, true);
+  c.a = decodeBC3Alpha(block, i);
+  return c;
+}
+
+glm::vec4 Texture::getTexel(int level, int x, int y) const {
+  switch (format) {
+  case TextureFormat::RGBA8:
+    return fetch<TextureFormat::RGBA8>(levels[level], x, y);
+  case TextureFormat::BC1:
+    return fetch<TextureFormat::BC1>(levels[level], x, y);
+  case TextureFormat::BC3:
+    return fetch<TextureFormat::BC3>(levels[level], x, y);
+  default:
+    return fetch<TextureFormat::RGBA32F>(levels[level], x, y);
+  }
+}
+
+glm::vec4 Texture::getTexel(const glm::vec2 &texCoords) const {
   // clamp u and v
   float u = glm::clamp(texCoords.x, 0.f, 1.f);
   float v = glm::clamp(texCoords.y, 0.f, 1.f);
 
-  int x = std::floor(u * width);
-  int y = std::floor(v * height);
+  int x = std::min((int)std::floor(u * width), width - 1);
+  int y = std::min((int)std::floor(v * height), height - 1);
+
+  return getTexel(0, x, y);
+}
+
+template <TextureFormat F>
+glm::vec4 Texture::sampleNearest(const Level &level,
+                                 const glm::vec2 &uv) const {
+  const glm::vec2 t = glm::clamp(uv, 0.f, 1.f);
+  const int x = std::min((int)(t.x * level.width), level.width - 1);
+  const int y = std::min((int)(t.y * level.height), level.height - 1);
+  return fetch<F>(level, x, y);
+}
+
+template <TextureFormat F>
+glm::vec4 Texture::sampleBilinear(const Level &level,
+                                  const glm::vec2 &uv) const {
+  // Texel centers are at half-integer coordinates.
+  const glm::vec2 t = glm::clamp(uv, 0.f, 1.f) *
+                          glm::vec2(level.width, level.height) -
+                      0.5f;
+  const glm::vec2 base = glm::floor(t);
+  const glm::vec2 f = t - base;
+
+  const int x0 = glm::clamp((int)base.x, 0, level.width - 1);
+  const int y0 = glm::clamp((int)base.y, 0, level.height - 1);
+  const int x1 = std::min((int)base.x + 1, level.width - 1);
+  const int y1 = std::min((int)base.y + 1, level.height - 1);
+
+  return glm::mix(glm::mix(fetch<F>(level, x0, y0), fetch<F>(level, x1, y0),
+                           f.x),
+                  glm::mix(fetch<F>(level, x0, y1), fetch<F>(level, x1, y1),
+                           f.x),
+                  f.y);
+}
+
+template <TextureFormat F>
+glm::vec4 Texture::sample(const glm::vec2 &texCoords) const {
+  if (filter == TextureFilter::NEAREST)
+    return sampleNearest<F>(levels[0], texCoords);
+  return sampleBilinear<F>(levels[0], texCoords);
+}
 
-  return getTexel(x, y);
+glm::vec4 Texture::sample(const glm::vec2 &texCoords) const {
+  switch (format) {
+  case TextureFormat::RGBA8:
+    return sample<TextureFormat::RGBA8>(texCoords);
+  case TextureFormat::BC1:
+    return sample<TextureFormat::BC1>(texCoords);
+  case TextureFormat::BC3:
+    return sample<TextureFormat::BC3>(texCoords);
+  default:
+    return sample<TextureFormat::RGBA32F>(texCoords);
+  }
+}
+
+glm::vec4 Texture::sample(const glm::vec2 &texCoords,
+                          const glm::vec2 &texCoordsDx,
+                          const glm::vec2 &texCoordsDy) const {
+  return sampleLevel(texCoords, computeLod(texCoordsDx, texCoordsDy));
+}
+
+template <TextureFormat F>
+glm::vec4 Texture::sampleLevel(const glm::vec2 &texCoords, float lod) const {
+  const float maxLevel = levels.size() - 1;
+  lod = glm::clamp(lod, 0.f, maxLevel);
+
+  switch (filter) {
+  case TextureFilter::NEAREST:
+    return sampleNearest<F>(levels[(int)(lod + 0.5f)], texCoords);
+  case TextureFilter::BILINEAR:
+    return sampleBilinear<F>(levels[(int)(lod + 0.5f)], texCoords);
+  default: {
+    const int level = std::min((int)lod, (int)maxLevel - 1);
+    if (level < 0)
+      return sampleBilinear<F>(levels[0], texCoords);
+    return glm::mix(sampleBilinear<F>(levels[level], texCoords),
+                    sampleBilinear<F>(levels[level + 1], texCoords),
+                    lod - level);
+  }
+  }
+}
+
+glm::vec4 Texture::sampleLevel(const glm::vec2 &texCoords, float lod) const {
+  switch (format) {
+  case TextureFormat::RGBA8:
+    return sampleLevel<TextureFormat::RGBA8>(texCoords, lod);
+  case TextureFormat::BC1:
+    return sampleLevel<TextureFormat::BC1>(texCoords, lod);
+  case TextureFormat::BC3:
+    return sampleLevel<TextureFormat::BC3>(texCoords, lod);
+  default:
+    return sampleLevel<TextureFormat::RGBA32F>(texCoords, lod);
+  }
+}
+
+float Texture::computeLod(const glm::vec2 &texCoordsDx,
+                          const glm::vec2 &texCoordsDy) const {
+  const glm::vec2 size(width, height);
+  const float dx = glm::dot(texCoordsDx * size, texCoordsDx * size);
+  const float dy = glm::dot(texCoordsDy * size, texCoordsDy * size);
+
+  // log2 of the length, from the squared length.
+  const float rho = std::max(dx, dy);
+  return rho > 0.f ? 0.5f * std::log2(rho) : 0.f;
 }
 
 std::unique_ptr<Texture> Texture::makeFlat(int width, int height,
@@ -35,10 +485,13 @@ std::unique_ptr<Texture> Texture::makeFlat(int width, int height,
   // Constructor is private so we cannot call make_unique...
   std::unique_ptr<Texture> texture(new Texture(width, height));
 
-  for (int i = 0; i < width * height; ++i) {
-    texture->data[i] = fillColor;
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      texture->setTexel(x, y, fillColor);
+    }
   }
 
+  texture->generateMipmaps();
   return texture;
 }
 
@@ -70,35 +523,28 @@ std::unique_ptr<Texture> Texture::makeCheckerboard(int width, int height,
     }
   }
 
+  texture->generateMipmaps();
   return texture;
 }
 
 std::unique_ptr<Texture> Texture::loadPPM(const std::string &filename) {
-  std::ifstream file(filename);
+  const std::unique_ptr<Image> image = readPPM(filename);
 
-  if (!file.is_open()) {
+  if (!image) {
     return nullptr;
   }
 
-  std::string header;
-  file >> header;
-
-  if (header != "P3") {
-    return nullptr;
-  }
-
-  int width, height, maxVal;
-  file >> width >> height >> maxVal;
-
   // Constructor is private so we cannot call make_unique...
-  std::unique_ptr<Texture> texture(new Texture(width, height));
+  std::unique_ptr<Texture> texture(
+      new Texture(image->width, image->height));
 
-  for (int i = 0; i < width * height; ++i) {
-    int r, g, b;
-    file >> r >> g >> b;
-    texture->data[i] = glm::vec4(glm::vec3(r, g, b) / (float)maxVal, 1);
+  const unsigned char *rgb = image->pixels.data();
+  glm::vec4 *texels = texture->getFloatTexels(0);
+  for (size_t i = 0; i < (size_t)image->width * image->height; ++i, rgb += 3) {
+    texels[i] = glm::vec4(rgb[0], rgb[1], rgb[2], 255.f) * (1.f / 255);
   }
 
+  texture->generateMipmaps();
   return texture;
 }
 
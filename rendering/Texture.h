@@ -5,16 +5,98 @@
 #define GFX1993_TEXTURE_H
 
 #include <memory>
+#include <vector>
 
 #include <glm/glm.hpp>
 
+#include "BufferLayout.h"
+
 namespace render {
 
+// Storage format of the texels. Texels are decoded to float RGBA when they are
+// sampled.
+enum class TextureFormat {
+  // 32 bit float per channel.
+  RGBA32F,
+  // 8 bit unsigned normalized per channel.
+  RGBA8,
+  // Blocks of 4x4 texels in 8 bytes: two RGB565 end points and a 2 bit index
+  // per texel into the colors between them. Alpha is 1 bit; blocks with texels
+  // of alpha below one half use one of the indices for transparent black.
+  BC1,
+  // Blocks of 4x4 texels in 16 bytes: 8 bit alpha end points with a 3 bit
+  // index per texel, followed by an opaque BC1 block.
+  BC3
+};
+
+// How texels are looked up and combined when sampling a texture.
+enum class TextureFilter {
+  // The texel closest to the sample position.
+  NEAREST,
+  // Weighted average of the four closest texels.
+  BILINEAR,
+  // Bilinear samples from the two closest mip levels, blended by the level of
+  // detail.
+  TRILINEAR
+};
+
+// An RGBA texture with a complete mip chain. The factories fill the base level
+// and generate the smaller levels from it right away, each by averaging 2x2
+// texels of the previous one. Texture coordinates are clamped to [0, 1].
+//
+// Textures are created as RGBA32F with a linear layout; setStorage() converts
+// them to a smaller format or to a tiled layout.
 class Texture {
 public:
   virtual ~Texture();
 
-  const glm::vec4 &getTexel(const glm::vec2 &texCoords) const;
+  // Nearest texel of the base level.
+  glm::vec4 getTexel(const glm::vec2 &texCoords) const;
+
+  // Samples the base level with the texture's filter; trilinear filtering
+  // falls back to bilinear.
+  glm::vec4 sample(const glm::vec2 &texCoords) const;
+
+  // Samples with the level of detail that follows from the screen-space
+  // derivatives of the texture coordinates, see ShadingGeometry.
+  glm::vec4 sample(const glm::vec2 &texCoords, const glm::vec2 &texCoordsDx,
+                   const glm::vec2 &texCoordsDy) const;
+
+  // Samples at the given level of detail: 0 is the base level, every level
+  // above halves the resolution. Clamped to the available levels.
+  glm::vec4 sampleLevel(const glm::vec2 &texCoords, float lod) const;
+
+  // The level of detail for texture coordinates that change by the given
+  // amounts from one pixel to the next: the log2 of the number of base level
+  // texels covered by a pixel along its longer axis.
+  float computeLod(const glm::vec2 &texCoordsDx,
+                   const glm::vec2 &texCoordsDy) const;
+
+  // Re-encodes all levels in the given format and layout. The block
+  // compressed formats are always stored block by block and ignore the
+  // layout. Conversion starts from the texels as they are currently stored,
+  // so going from one lossy format to another adds up the errors.
+  void setStorage(TextureFormat format,
+                  BufferLayout layout = BufferLayout::LINEAR);
+
+  inline TextureFormat getFormat() const { return format; }
+  inline BufferLayout getLayout() const { return layout; }
+
+  // Bytes taken by the texels of all levels.
+  inline size_t getStorageSize() const { return storageSize; }
+
+  inline void setFilter(TextureFilter f) { filter = f; }
+  inline TextureFilter getFilter() const { return filter; }
+
+  inline int getWidth() const { return width; }
+  inline int getHeight() const { return height; }
+  inline int getLevelCount() const { return levels.size(); }
+
+  // Dimensions and texel of a mip level.
+  inline int getWidth(int level) const { return levels[level].width; }
+  inline int getHeight(int level) const { return levels[level].height; }
+
+  glm::vec4 getTexel(int level, int x, int y) const;
 
   static std::unique_ptr<Texture> makeFlat(int width, int height,
                                            const glm::vec4 &fillColor);
@@ -24,21 +106,61 @@ public:
                                                    const glm::vec4 &a,
                                                    const glm::vec4 &b);
 
+  // Loads a binary or ASCII PPM file, see readPPM().
   static std::unique_ptr<Texture> loadPPM(const std::string &filename);
 
 private:
+  struct Level {
+    int width, height;
+    // Tiles per row for the tiled layout, blocks per row for the block
+    // compressed formats.
+    unsigned int tilesX;
+    unsigned char *texels;
+  };
+
   int width, height;
-  glm::vec4 *data;
+  TextureFilter filter;
+  TextureFormat format;
+  BufferLayout layout;
+
+  // All levels in a single allocation, the base level first.
+  std::unique_ptr<glm::vec4[]> data;
+  size_t storageSize;
+  std::vector<Level> levels;
 
   explicit Texture(int width, int height);
 
-  inline const glm::vec4 &getTexel(int x, int y) const {
-    return data[x + y * width];
+  // Lays out the levels for the current format and layout and allocates their
+  // storage.
+  void allocateLevels();
+
+  // Only for filling a texture that is still RGBA32F and linear.
+  inline glm::vec4 *getFloatTexels(int level) const {
+    return reinterpret_cast<glm::vec4 *>(levels[level].texels);
   }
 
   inline void setTexel(int x, int y, const glm::vec4 &c) {
-    data[x + y * width] = c;
+    getFloatTexels(0)[x + y * width] = c;
   }
+
+  // Fills all levels above the base level; the texture still has to be
+  // RGBA32F and linear.
+  void generateMipmaps();
+
+  // The implementations for the storage formats.
+  template <TextureFormat F>
+  glm::vec4 fetch(const Level &level, int x, int y) const;
+
+  template <TextureFormat F>
+  glm::vec4 sampleNearest(const Level &level, const glm::vec2 &uv) const;
+
+  template <TextureFormat F>
+  glm::vec4 sampleBilinear(const Level &level, const glm::vec2 &uv) const;
+
+  template <TextureFormat F> glm::vec4 sample(const glm::vec2 &uv) const;
+
+  template <TextureFormat F>
+  glm::vec4 sampleLevel(const glm::vec2 &uv, float lod) const;
 };
 
 } // namespace render
@@ -0,0 +1,226 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#include "Image.h"
+#include "Texture.h"
+
+using namespace render;
+using glm::vec2;
+using glm::vec3;
+using glm::vec4;
+
+static const vec4 BLACK(0, 0, 0, 1);
+static const vec4 WHITE(1, 1, 1, 1);
+
+bool nearlyEqual(const vec4 &a, const vec4 &b) {
+  const vec4 d = glm::abs(a - b);
+  return d.x < 1e-5f && d.y < 1e-5f && d.z < 1e-5f && d.w < 1e-5f;
+}
+
+int testMipChain() {
+  // Levels halve down to 1x1; odd sizes round down.
+  auto texture = Texture::makeFlat(64, 16, WHITE);
+  assert(texture->getLevelCount() == 7);
+  for (int i = 0; i < texture->getLevelCount(); ++i) {
+    assert(texture->getWidth(i) == std::max(64 >> i, 1));
+    assert(texture->getHeight(i) == std::max(16 >> i, 1));
+    assert(texture->getTexel(i, 0, 0) == WHITE);
+  }
+
+  auto odd = Texture::makeFlat(5, 3, WHITE);
+  assert(odd->getLevelCount() == 3);
+  assert(odd->getWidth(1) == 2 && odd->getHeight(1) == 1);
+  assert(odd->getTexel(2, 0, 0) == WHITE);
+
+  // The levels of a checkerboard with single texel checkers are all grey.
+  auto checkerboard = Texture::makeCheckerboard(8, 8, 1, BLACK, WHITE);
+  assert(checkerboard->getTexel(0, 0, 0) != checkerboard->getTexel(0, 1, 0));
+  for (int i = 1; i < checkerboard->getLevelCount(); ++i) {
+    assert(nearlyEqual(checkerboard->getTexel(i, 0, 0), (BLACK + WHITE) * .5f));
+  }
+
+  return 0;
+}
+
+int testBilinear() {
+  auto texture = Texture::makeCheckerboard(2, 2, 1, BLACK, WHITE);
+  const vec4 a = texture->getTexel(0, 0, 0);
+  const vec4 b = texture->getTexel(0, 1, 0);
+  texture->setFilter(TextureFilter::BILINEAR);
+
+  // Texel centers give the texels, points between them interpolate, and
+  // coordinates are clamped at the edges.
+  assert(nearlyEqual(texture->sample(vec2(0.25f, 0.25f)), a));
+  assert(nearlyEqual(texture->sample(vec2(0.75f, 0.25f)), b));
+  assert(nearlyEqual(texture->sample(vec2(0.5f, 0.25f)), (a + b) * .5f));
+  assert(nearlyEqual(texture->sample(vec2(0.375f, 0.25f)),
+                     a * .75f + b * .25f));
+  assert(nearlyEqual(texture->sample(vec2(0.f, 0.f)), a));
+  assert(nearlyEqual(texture->sample(vec2(-1.f, 2.f)),
+                     texture->getTexel(0, 0, 1)));
+
+  texture->setFilter(TextureFilter::NEAREST);
+  assert(texture->sample(vec2(0.49f, 0.25f)) == a);
+  assert(texture->sample(vec2(0.51f, 0.25f)) == b);
+  return 0;
+}
+
+int testTrilinear() {
+  auto texture = Texture::makeCheckerboard(64, 64, 1, BLACK, WHITE);
+
+  // One texel per pixel is the base level, four texels per pixel the third.
+  assert(texture->computeLod(vec2(1.f / 64, 0), vec2(0, 1.f / 64)) == 0.f);
+  assert(texture->computeLod(vec2(4.f / 64, 0), vec2(0, 1.f / 64)) == 2.f);
+  assert(texture->computeLod(vec2(0, 0), vec2(0, 4.f / 64)) == 2.f);
+  assert(texture->computeLod(vec2(0), vec2(0)) == 0.f);
+
+  // Blend between the base level and the grey first level.
+  const vec2 uv(0.5f / 64, 0.5f / 64);
+  const vec4 a = texture->getTexel(0, 0, 0);
+  const vec4 grey = (BLACK + WHITE) * .5f;
+  texture->setFilter(TextureFilter::TRILINEAR);
+  assert(nearlyEqual(texture->sampleLevel(uv, 0.f), a));
+  assert(nearlyEqual(texture->sampleLevel(uv, 0.5f), (a + grey) * .5f));
+  assert(nearlyEqual(texture->sampleLevel(uv, 1.f), grey));
+  assert(nearlyEqual(texture->sampleLevel(uv, 100.f), grey));
+
+  // Minified far enough, the checkerboard averages out.
+  const vec2 d(16.f / 64, 0);
+  assert(nearlyEqual(texture->sample(uv, d, vec2(0)), grey));
+
+  // Without mipmaps the pattern aliases instead.
+  texture->setFilter(TextureFilter::NEAREST);
+  assert(texture->sampleLevel(uv, 0.f) == a);
+  return 0;
+}
+
+int testStorageFormats() {
+  // Two colors per block, with alpha for the formats that keep it.
+  const vec4 a(0.2f, 0.4f, 0.6f, 1.f), b(0.9f, 0.1f, 0.3f, 0.25f);
+  auto reference = Texture::makeCheckerboard(64, 32, 2, a, b);
+  assert(reference->getStorageSize() == 2731 * sizeof(vec4));
+
+  // Rounding errors of 8 bit channels and of RGB565 end points.
+  const float unorm8 = 0.5f / 255 + 1e-6f, unorm5 = 0.5f / 31 + 1e-6f;
+  const struct {
+    TextureFormat format;
+    BufferLayout layout;
+    size_t size;
+    float tolerance;
+  } storages[] = {
+      {TextureFormat::RGBA32F, BufferLayout::TILED, 2944 * sizeof(vec4), 0.f},
+      {TextureFormat::RGBA8, BufferLayout::LINEAR, 2731 * 4, unorm8},
+      {TextureFormat::RGBA8, BufferLayout::TILED, 2944 * 4, unorm8},
+      {TextureFormat::BC1, BufferLayout::LINEAR, 173 * 8, unorm5},
+      {TextureFormat::BC3, BufferLayout::LINEAR, 173 * 16, unorm5},
+  };
+
+  for (const auto &storage : storages) {
+    auto texture = Texture::makeCheckerboard(64, 32, 2, a, b);
+    texture->setStorage(storage.format, storage.layout);
+    assert(texture->getStorageSize() == storage.size);
+
+    for (int i = 0; i < texture->getLevelCount(); ++i) {
+      for (int y = 0; y < texture->getHeight(i); ++y) {
+        for (int x = 0; x < texture->getWidth(i); ++x) {
+          vec4 expected = reference->getTexel(i, x, y);
+          // BC1 has 1 bit alpha; transparent texels turn black.
+          if (storage.format == TextureFormat::BC1)
+            expected = expected.a < 0.5f ? vec4(0.f) : vec4(vec3(expected), 1);
+          const vec4 d = glm::abs(texture->getTexel(i, x, y) - expected);
+          assert(d.r <= storage.tolerance && d.g <= storage.tolerance &&
+                 d.b <= storage.tolerance &&
+                 d.a <= std::max(storage.tolerance, unorm8));
+        }
+      }
+    }
+
+    // Sampling decodes the same texels; BC1 has turned some of them black.
+    texture->setFilter(TextureFilter::TRILINEAR);
+    reference->setFilter(TextureFilter::TRILINEAR);
+    const vec2 uv(0.3f, 0.7f);
+    const vec4 d = glm::abs(texture->sampleLevel(uv, 0.4f) -
+                            reference->sampleLevel(uv, 0.4f));
+    assert(storage.format == TextureFormat::BC1 ||
+           (d.r <= storage.tolerance && d.g <= storage.tolerance &&
+            d.b <= storage.tolerance));
+  }
+
+  return 0;
+}
+
+int testPPM() {
+  // Binary round trip.
+  Image image;
+  image.width = 3;
+  image.height = 2;
+  for (unsigned char c = 0; c < 18; ++c)
+    image.pixels.push_back(c * 15);
+
+  const std::string binaryFile = "gfx93-texture-test-p6.ppm";
+  assert(writePPM(binaryFile, image));
+  auto read = readPPM(binaryFile);
+  assert(read && read->width == 3 && read->height == 2);
+  assert(read->pixels == image.pixels);
+
+  auto texture = Texture::loadPPM(binaryFile);
+  assert(texture && texture->getWidth() == 3 && texture->getHeight() == 2);
+  assert(nearlyEqual(texture->getTexel(0, 2, 1),
+                     vec4(225, 240, 255, 255) / 255.f));
+
+  // ASCII with comments and a different maximum value.
+  const std::string asciiFile = "gfx93-texture-test-p3.ppm";
+  std::ofstream(asciiFile) << "P3\n# comment\n2 1 # size\n15\n"
+                              "0 15 5\n10 1 15\n";
+  read = readPPM(asciiFile);
+  assert(read && read->width == 2 && read->height == 1);
+  const std::vector<unsigned char> expected = {0, 255, 85, 170, 17, 255};
+  assert(read->pixels == expected);
+
+  // Truncated pixel data.
+  std::ofstream(binaryFile, std::ios::binary) << "P6 2 2 255\nabc";
+  assert(!readPPM(binaryFile));
+
+  // Sizes far beyond the data are rejected before anything is allocated.
+  std::ofstream(binaryFile, std::ios::binary)
+      << "P6 16777215 16777215 255\nabc";
+  assert(!readPPM(binaryFile));
+  assert(!Texture::loadPPM(binaryFile));
+  std::ofstream(asciiFile) << "P3 16777215 16777215 255\n1 2 3\n";
+  assert(!readPPM(asciiFile));
+  assert(!Texture::loadPPM("gfx93-texture-test-missing.ppm"));
+
+  std::remove(binaryFile.c_str());
+  std::remove(asciiFile.c_str());
+  return 0;
+}
+
+int main(int argc, const char **argv) {
+  const std::string test(argv[1]);
+
+  if (test == "mip-chain") {
+    return testMipChain();
+  }
+
+  if (test == "bilinear") {
+    return testBilinear();
+  }
+
+  if (test == "trilinear") {
+    return testTrilinear();
+  }
+
+  if (test == "storage-formats") {
+    return testStorageFormats();
+  }
+
+  if (test == "ppm") {
+    return testPPM();
+  }
+
+  return 0;
+}
@@ -0,0 +1,140 @@
+#include "VertexBuffer.h"
+
+#include <algorithm>
+#include <utility>
+
+using namespace render;
+
+VertexBuffer::VertexBuffer(const VertexList &vertices) { assign(vertices); }
+
+Vertex &VertexBuffer::operator[](size_t i) {
+  markDirty(i, i + 1);
+  boundsValid = false;
+  return vertices[i];
+}
+
+Vertex &VertexBuffer::back() { return (*this)[vertices.size() - 1]; }
+
+Vertex *VertexBuffer::data() {
+  markDirty(0, vertices.size());
+  boundsValid = false;
+  return vertices.data();
+}
+
+void VertexBuffer::push_back(const Vertex &v) {
+  vertices.push_back(v);
+  markDirty(vertices.size() - 1, vertices.size());
+
+  // Growing the bounds is cheap, no need to throw them away.
+  if (boundsValid) {
+    boundsMin = glm::min(boundsMin, glm::vec3(v.position));
+    boundsMax = glm::max(boundsMax, glm::vec3(v.position));
+  }
+}
+
+void VertexBuffer::reserve(size_t count) { vertices.reserve(count); }
+
+void VertexBuffer::assign(const VertexList &list) {
+  vertices = list;
+  markDirty(0, vertices.size());
+  boundsValid = false;
+}
+
+void VertexBuffer::assign(VertexList &&list, const glm::vec3 &min,
+                          const glm::vec3 &max) {
+  vertices = std::move(list);
+  markDirty(0, vertices.size());
+  boundsMin = min;
+  boundsMax = max;
+  boundsValid = true;
+}
+
+void VertexBuffer::clear() {
+  vertices.clear();
+  clearDirty();
+  boundsValid = false;
+  transformCache.vertices.clear();
+}
+
+const glm::vec3 &VertexBuffer::getBoundsMin() const {
+  updateBounds();
+  return boundsMin;
+}
+
+const glm::vec3 &VertexBuffer::getBoundsMax() const {
+  updateBounds();
+  return boundsMax;
+}
+
+void VertexBuffer::markDirty(size_t begin, size_t end) {
+  if (dirtyBegin < dirtyEnd) {
+    dirtyBegin = std::min(dirtyBegin, begin);
+    dirtyEnd = std::max(dirtyEnd, end);
+  } else {
+    dirtyBegin = begin;
+    dirtyEnd = end;
+  }
+}
+
+void VertexBuffer::clearDirty() const {
+  dirtyBegin = 0;
+  dirtyEnd = 0;
+}
+
+void VertexBuffer::updateBounds() const {
+  if (boundsValid)
+    return;
+
+  if (vertices.empty()) {
+    boundsMin = boundsMax = glm::vec3(0.f);
+  } else {
+    boundsMin = boundsMax = glm::vec3(vertices[0].position);
+    for (const Vertex &v : vertices) {
+      boundsMin = glm::min(boundsMin, glm::vec3(v.position));
+      boundsMax = glm::max(boundsMax, glm::vec3(v.position));
+    }
+  }
+  boundsValid = true;
+}
+
+IndexBuffer::IndexBuffer(const IndexList &indices) { assign(indices); }
+
+unsigned int &IndexBuffer::operator[](size_t i) {
+  maxIndexValid = false;
+  return indices[i];
+}
+
+void IndexBuffer::push_back(unsigned int index) {
+  indices.push_back(index);
+  if (maxIndexValid)
+    requiredVertices = std::max(requiredVertices, (size_t)index + 1);
+}
+
+void IndexBuffer::reserve(size_t count) { indices.reserve(count); }
+
+void IndexBuffer::assign(const IndexList &list) {
+  indices = list;
+  maxIndexValid = false;
+}
+
+void IndexBuffer::assign(IndexList &&list, size_t requiredVertexCount) {
+  indices = std::move(list);
+  requiredVertices = requiredVertexCount;
+  maxIndexValid = true;
+}
+
+void IndexBuffer::clear() {
+  indices.clear();
+  requiredVertices = 0;
+  maxIndexValid = true;
+}
+
+size_t IndexBuffer::getRequiredVertexCount() const {
+  if (!maxIndexValid) {
+    requiredVertices = 0;
+    for (unsigned int index : indices)
+      requiredVertices = std::max(requiredVertices, (size_t)index + 1);
+    maxIndexValid = true;
+  }
+  return requiredVertices;
+}
@@ -0,0 +1,140 @@
+#ifndef GFX1993_VERTEXBUFFER_H
+#define GFX1993_VERTEXBUFFER_H
+
+#include "Pipeline.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace render {
+
+class Rasterizer;
+
+// A vertex list that is kept alive between frames. The rasterizer caches data
+// derived from it -- the model-space bounds and the transformed vertices -- in
+// the buffer itself and only recomputes it for the vertices that changed since
+// the last draw. Every write through the non-const interface marks the written
+// vertices as dirty; appending leaves the already transformed vertices alone.
+//
+// Drawing a buffer updates this cached data even through a const reference,
+// and the cache holds the transform of one draw at a time. A buffer must
+// therefore not be drawn, or have its bounds queried, on several threads at
+// once; give each thread a buffer of its own, or draw one after the other.
+class VertexBuffer {
+public:
+  VertexBuffer() = default;
+
+  explicit VertexBuffer(const VertexList &vertices);
+
+  // Read access
+  inline const VertexList &getVertices() const { return vertices; }
+  inline size_t size() const { return vertices.size(); }
+  inline bool empty() const { return vertices.empty(); }
+  inline const Vertex &operator[](size_t i) const { return vertices[i]; }
+  inline const Vertex &back() const { return vertices.back(); }
+  inline VertexList::const_iterator begin() const { return vertices.begin(); }
+  inline VertexList::const_iterator end() const { return vertices.end(); }
+
+  // Write access. The returned reference may be written to until the next
+  // draw call that uses this buffer.
+  Vertex &operator[](size_t i);
+  Vertex &back();
+
+  // All vertices at once, e.g. for writing them from several threads. Marks
+  // all of them as dirty.
+  Vertex *data();
+
+  void push_back(const Vertex &v);
+  void reserve(size_t count);
+  void assign(const VertexList &list);
+  void clear();
+
+  // Takes over a list whose bounds are already known, e.g. from a file.
+  void assign(VertexList &&list, const glm::vec3 &boundsMin,
+              const glm::vec3 &boundsMax);
+
+  // Axis-aligned bounding box of all vertex positions in model space. Both
+  // corners are zero for an empty buffer.
+  const glm::vec3 &getBoundsMin() const;
+  const glm::vec3 &getBoundsMax() const;
+
+  // The range [begin, end) of vertices written to since the derived data was
+  // last brought up to date. It is empty if begin >= end.
+  inline size_t getDirtyBegin() const { return dirtyBegin; }
+  inline size_t getDirtyEnd() const { return dirtyEnd; }
+  inline bool isDirty() const { return dirtyBegin < dirtyEnd; }
+
+private:
+  VertexList vertices;
+
+  // Dirty range; updated by the rasterizer when it refreshes its cache.
+  mutable size_t dirtyBegin = 0;
+  mutable size_t dirtyEnd = 0;
+
+  mutable bool boundsValid = false;
+  mutable glm::vec3 boundsMin = glm::vec3(0.f);
+  mutable glm::vec3 boundsMax = glm::vec3(0.f);
+
+  // The vertices after the last transform, together with the shader and its
+  // state at that time. Maintained by Rasterizer.
+  struct TransformCache {
+    // VertexShader::getId(); ids start at 1.
+    uint64_t shaderId = 0;
+    std::vector<float> state;
+    VertexOutList vertices;
+    bool valid = false;
+  };
+  mutable TransformCache transformCache;
+
+  friend class Rasterizer;
+
+  void markDirty(size_t begin, size_t end);
+
+  void clearDirty() const;
+
+  void updateBounds() const;
+};
+
+// An index list that is kept alive between frames, see VertexBuffer. It keeps
+// track of the highest index so that draws can check it against the vertex
+// buffer without scanning all indices.
+class IndexBuffer {
+public:
+  IndexBuffer() = default;
+
+  explicit IndexBuffer(const IndexList &indices);
+
+  // Read access
+  inline const IndexList &getIndices() const { return indices; }
+  inline size_t size() const { return indices.size(); }
+  inline bool empty() const { return indices.empty(); }
+  inline unsigned int operator[](size_t i) const { return indices[i]; }
+  inline IndexList::const_iterator begin() const { return indices.begin(); }
+  inline IndexList::const_iterator end() const { return indices.end(); }
+
+  // Write access
+  unsigned int &operator[](size_t i);
+
+  void push_back(unsigned int index);
+  void reserve(size_t count);
+  void assign(const IndexList &list);
+  void clear();
+
+  // Takes over a list whose highest index is already known.
+  void assign(IndexList &&list, size_t requiredVertexCount);
+
+  // Number of vertices the indices require, i.e. the highest index plus one;
+  // zero if the buffer is empty.
+  size_t getRequiredVertexCount() const;
+
+private:
+  IndexList indices;
+
+  mutable bool maxIndexValid = true;
+  mutable size_t requiredVertices = 0;
+};
+
+} // namespace render
+
+#endif // GFX1993_VERTEXBUFFER_H
@@ -0,0 +1,88 @@
+#include "WorkerPool.h"
+
+namespace render {
+
+WorkerPool::WorkerPool(unsigned int threadCount)
+    : job(nullptr), jobCount(0), nextJob(0), busyWorkers(0), generation(0),
+      shutdown(false) {
+  for (unsigned int i = 1; i < threadCount; ++i) {
+    threads.emplace_back(&WorkerPool::workerLoop, this);
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    shutdown = true;
+  }
+  wakeup.notify_all();
+
+  for (auto &t : threads) {
+    t.join();
+  }
+}
+
+void WorkerPool::parallelFor(size_t count,
+                             const std::function<void(size_t)> &fn) {
+  // Not worth waking anybody up.
+  if (threads.empty() || count <= 1) {
+    for (size_t i = 0; i < count; ++i) {
+      fn(i);
+    }
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    job = &fn;
+    jobCount = count;
+    nextJob = 0;
+    busyWorkers = threads.size();
+    ++generation;
+  }
+  wakeup.notify_all();
+
+  runJobs(fn, count);
+
+  // Wait for the stragglers; fn must stay alive until they are done.
+  std::unique_lock<std::mutex> lock(mutex);
+  finished.wait(lock, [this]() { return busyWorkers == 0; });
+  job = nullptr;
+}
+
+void WorkerPool::workerLoop() {
+  unsigned int seenGeneration = 0;
+
+  for (;;) {
+    const std::function<void(size_t)> *fn;
+    size_t count;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wakeup.wait(lock, [&]() {
+        return shutdown || generation != seenGeneration;
+      });
+      if (shutdown) {
+        return;
+      }
+      seenGeneration = generation;
+      fn = job;
+      count = jobCount;
+    }
+
+    runJobs(*fn, count);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (--busyWorkers == 0) {
+      finished.notify_one();
+    }
+  }
+}
+
+void WorkerPool::runJobs(const std::function<void(size_t)> &fn,
+                         size_t count) {
+  for (size_t i = nextJob++; i < count; i = nextJob++) {
+    fn(i);
+  }
+}
+
+} // namespace render
@@ -0,0 +1,54 @@
+#ifndef GFX1993_WORKERPOOL_H
+#define GFX1993_WORKERPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace render {
+
+// A fixed set of worker threads that run indexed jobs in parallel. The calling
+// thread takes part in the work and blocks until all jobs are finished.
+class WorkerPool {
+public:
+  // Creates a pool that runs jobs on threadCount threads in total, including
+  // the calling thread. A thread count of 1 runs everything inline.
+  explicit WorkerPool(unsigned int threadCount);
+
+  ~WorkerPool();
+
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool &operator=(const WorkerPool &) = delete;
+
+  // Calls job(i) for every i in [0, count) and returns once all calls have
+  // returned. Jobs are picked up in ascending order but may run concurrently.
+  void parallelFor(size_t count, const std::function<void(size_t)> &job);
+
+  inline unsigned int getThreadCount() const { return threads.size() + 1; }
+
+private:
+  std::vector<std::thread> threads;
+
+  std::mutex mutex;
+  std::condition_variable wakeup;
+  std::condition_variable finished;
+
+  // The current batch of jobs; guarded by the mutex except for nextJob.
+  const std::function<void(size_t)> *job;
+  size_t jobCount;
+  std::atomic<size_t> nextJob;
+  unsigned int busyWorkers;
+  unsigned int generation;
+  bool shutdown;
+
+  void workerLoop();
+
+  void runJobs(const std::function<void(size_t)> &fn, size_t count);
+};
+
+} // namespace render
+
+#endif // GFX1993_WORKERPOOL_H